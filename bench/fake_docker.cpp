@@ -0,0 +1,288 @@
+/*!
+ * dockerpack.
+ * fake_docker.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+// Deterministic stand-in for "docker" command line client used by dockerpack-bench.
+// Answers only what cli backend asks, never touches real containers.
+//
+// Environment:
+//  FAKE_DOCKER_LOG         - every invocation is appended to this file as one line: "<subcommand> <args...>"
+//  FAKE_DOCKER_LATENCY_MS  - sleep before answering, simulates daemon round trip (default: 0)
+//  FAKE_DOCKER_IMAGES      - comma separated "repo:tag" list, printed by "docker images"
+//  FAKE_DOCKER_EXEC_LINES  - number of output lines printed by "docker exec" of benchmark step (default: 0)
+//  FAKE_DOCKER_REGISTRY    - comma separated "repo:tag" list of images which can be pulled (default: any image)
+//  FAKE_DOCKER_PULL_MS     - duration of image pull, also of implicit pull by "docker run" (default: 0)
+//  FAKE_DOCKER_PULLED      - file of pulled images, one per line. They are printed by "docker images" as local ones
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// dockerpack-bench step commands contain it
+static const char* STEP_MARKER = "bench-step";
+
+static std::string env_or(const char* name, const std::string& def) {
+    const char* value = std::getenv(name);
+    return value == nullptr ? def : std::string(value);
+}
+
+static long env_number(const char* name) {
+    const std::string value = env_or(name, "0");
+    char* end = nullptr;
+    const long n = std::strtol(value.c_str(), &end, 10);
+    return n < 0 ? 0 : n;
+}
+
+/// \brief Same input always gives same 64 hex chars, like docker container and image ids
+static std::string fake_id(const std::string& seed) {
+    uint64_t hash = 14695981039346656037ULL;
+    std::string out;
+    for (int part = 0; part < 4; part++) {
+        for (char c : seed) {
+            hash ^= (unsigned char) c;
+            hash *= 1099511628211ULL;
+        }
+        hash ^= (uint64_t) part;
+        hash *= 1099511628211ULL;
+        char buf[17];
+        std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long) hash);
+        out += buf;
+    }
+    return out;
+}
+
+static void log_invocation(const std::vector<std::string>& args) {
+    const std::string path = env_or("FAKE_DOCKER_LOG", "");
+    if (path.empty()) {
+        return;
+    }
+    std::string line;
+    for (const auto& arg : args) {
+        if (!line.empty()) {
+            line += ' ';
+        }
+        for (char c : arg) {
+            line += c == '\n' ? ' ' : c;
+        }
+    }
+    line += '\n';
+
+    // jobs run concurrently: whole line is written with one append
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        return;
+    }
+    ssize_t res = ::write(fd, line.data(), line.size());
+    (void) res;
+    ::close(fd);
+}
+
+/// \brief Value of option like "--name value"
+static std::string option_value(const std::vector<std::string>& args, const std::string& option) {
+    for (size_t i = 0; i + 1 < args.size(); i++) {
+        if (args[i] == option) {
+            return args[i + 1];
+        }
+    }
+    return std::string();
+}
+
+static std::string with_tag(std::string image) {
+    if (image.find(':') == std::string::npos) {
+        image += ":latest";
+    }
+    return image;
+}
+
+static std::vector<std::string> split_images(const std::string& list, char delimiter) {
+    std::vector<std::string> out;
+    std::stringstream ss(list);
+    std::string image;
+    while (std::getline(ss, image, delimiter)) {
+        if (!image.empty()) {
+            out.push_back(with_tag(image));
+        }
+    }
+    return out;
+}
+
+/// \brief FAKE_DOCKER_IMAGES and pulled ones
+static std::vector<std::string> local_images() {
+    std::vector<std::string> out = split_images(env_or("FAKE_DOCKER_IMAGES", ""), ',');
+    const std::string pulled_path = env_or("FAKE_DOCKER_PULLED", "");
+    if (!pulled_path.empty()) {
+        std::string content;
+        const int fd = ::open(pulled_path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            char buf[4096];
+            ssize_t n;
+            while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+                content.append(buf, (size_t) n);
+            }
+            ::close(fd);
+        }
+        for (auto& image : split_images(content, '\n')) {
+            out.push_back(std::move(image));
+        }
+    }
+    return out;
+}
+
+static int fake_images() {
+    std::vector<std::string> printed;
+    for (const auto& image : local_images()) {
+        if (std::find(printed.begin(), printed.end(), image) != printed.end()) {
+            continue;
+        }
+        printed.push_back(image);
+        std::cout << image << "|sha256:" << fake_id(image) << "\n";
+    }
+    return 0;
+}
+
+static int fake_pull(const std::string& reference) {
+    const std::string image = with_tag(reference);
+    const char* registry = std::getenv("FAKE_DOCKER_REGISTRY");
+    if (registry != nullptr) {
+        const auto available = split_images(registry, ',');
+        if (std::find(available.begin(), available.end(), image) == available.end()) {
+            std::cerr << "Error response from daemon: manifest for " << image << " not found: manifest unknown" << std::endl;
+            return 1;
+        }
+    }
+
+    const long duration = env_number("FAKE_DOCKER_PULL_MS");
+    if (duration > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(duration));
+    }
+
+    const std::string pulled_path = env_or("FAKE_DOCKER_PULLED", "");
+    if (!pulled_path.empty()) {
+        const std::string line = image + "\n";
+        const int fd = ::open(pulled_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd >= 0) {
+            ssize_t res = ::write(fd, line.data(), line.size());
+            (void) res;
+            ::close(fd);
+        }
+    }
+    std::cout << image << std::endl;
+    return 0;
+}
+
+static int fake_exec(const std::vector<std::string>& args) {
+    // docker exec [-w dir] [-e K=V]... container bash -c "script"
+    const std::string& script = args.back();
+
+    // bootstrap probe
+    if (script.find("@@dockerpack_env@@") != std::string::npos) {
+        std::cout << "@@dockerpack_env@@\n"
+                  << "HOME=/root\n"
+                  << "PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin\n"
+                  << "HOSTNAME=fake\n"
+                  << "@@dockerpack_os@@\n"
+                  << "NAME=\"Fake Linux\"\n"
+                  << "ID=fake\n"
+                  << "VERSION_ID=\"1\"\n"
+                  << "@@dockerpack_cpu@@\n"
+                  << "4\n";
+        return 0;
+    }
+    // output of service commands (copy, caches) is parsed, so only synthetic steps are chatty
+    if (script.find(STEP_MARKER) == std::string::npos) {
+        return 0;
+    }
+
+    const long lines = env_number("FAKE_DOCKER_EXEC_LINES");
+    for (long i = 0; i < lines; i++) {
+        std::cout << "fake output line " << i << ": " << script << "\n";
+    }
+    return 0;
+}
+
+static int fake_cp(const std::vector<std::string>& args) {
+    // docker cp - container:path reads tar from stdin
+    if (args.size() > 1 && args[1] == "-") {
+        char buf[64 * 1024];
+        while (std::fread(buf, 1, sizeof(buf), stdin) > 0) {
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    log_invocation(args);
+
+    const long latency = env_number("FAKE_DOCKER_LATENCY_MS");
+    if (latency > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(latency));
+    }
+
+    if (args.empty()) {
+        std::cerr << "fake docker: command is required" << std::endl;
+        return 1;
+    }
+
+    const std::string& command = args[0];
+    if (command == "ps" || command == "events") {
+        // there are no containers left from previous runs
+        return 0;
+    } else if (command == "images") {
+        return fake_images();
+    } else if (command == "run") {
+        // docker run [opts] --name name image /bin/bash: missing image is pulled implicitly
+        const std::string image = with_tag(args.size() > 2 ? args[args.size() - 2] : std::string());
+        const auto local = local_images();
+        if (std::find(local.begin(), local.end(), image) == local.end()) {
+            std::stringstream pull_out;
+            std::streambuf* out = std::cout.rdbuf(pull_out.rdbuf());
+            const int status = fake_pull(image);
+            std::cout.rdbuf(out);
+            if (status) {
+                return 125;
+            }
+        }
+        std::cout << fake_id(option_value(args, "--name")) << std::endl;
+        return 0;
+    } else if (command == "exec") {
+        return fake_exec(args);
+    } else if (command == "cp") {
+        return fake_cp(args);
+    } else if (command == "commit") {
+        std::cout << "sha256:" << fake_id(args.back()) << std::endl;
+        return 0;
+    } else if (command == "stop" || command == "rm" || command == "rmi") {
+        for (size_t i = 1; i < args.size(); i++) {
+            std::cout << args[i] << "\n";
+        }
+        return 0;
+    } else if (command == "volume") {
+        // volume create [opts] name, volume rm name
+        if (args.size() > 1) {
+            std::cout << args.back() << std::endl;
+        }
+        return 0;
+    } else if (command == "pull") {
+        return fake_pull(args.back());
+    } else if (command == "version") {
+        return 0;
+    }
+
+    std::cerr << "fake docker: unknown command " << command << std::endl;
+    return 1;
+}
@@ -0,0 +1,254 @@
+/*!
+ * dockerpack.
+ * main.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+// Measures dockerpack's own orchestration overhead: builder runs synthetic config against fake "docker" binary,
+// so numbers don't depend on docker daemon, images or network.
+
+#include "builder.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifndef DOCKERPACK_FAKE_DOCKER_DIR
+#define DOCKERPACK_FAKE_DOCKER_DIR ""
+#endif
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+struct bench_options {
+    size_t jobs = 8;
+    size_t steps = 10;
+    size_t copies = 2;
+    size_t files = 50;
+    size_t file_size = 4096;
+    size_t images = 1;
+    // last N of job images are missing locally and pulled from fake registry
+    size_t remote_images = 0;
+    size_t pull_ms = 0;
+    size_t pull_jobs = 4;
+    size_t parallel = 1;
+    size_t warm = 0;
+    size_t latency_ms = 0;
+    size_t exec_lines = 0;
+    bool sync = false;
+    std::string docker_dir = DOCKERPACK_FAKE_DOCKER_DIR;
+};
+
+static std::string image_name(size_t i) {
+    return "dockerpack/bench_" + std::to_string(i) + ":1";
+}
+
+/// \brief Creates copy sources and dockerpack.yml with N jobs x M steps x K copy paths
+static void write_project(const fs::path& root, const bench_options& opts) {
+    std::ofstream cfg((root / "dockerpack.yml").string());
+    cfg << "debug: false\n";
+    cfg << "commands_verbose: false\n";
+    cfg << "workdir: /root/bench\n";
+
+    if (opts.copies > 0) {
+        cfg << "copy:\n";
+    }
+    const std::string content(opts.file_size, 'x');
+    for (size_t k = 0; k < opts.copies; k++) {
+        const fs::path dir = root / "src" / ("copy_" + std::to_string(k));
+        fs::create_directories(dir);
+        for (size_t f = 0; f < opts.files; f++) {
+            std::ofstream((dir / ("file_" + std::to_string(f) + ".txt")).string()) << content;
+        }
+        cfg << "  - " << dir.string() << " /root/bench/copy_" << k << "\n";
+    }
+
+    cfg << "commands:\n";
+    cfg << "  bench:\n";
+    cfg << "    steps:\n";
+    for (size_t m = 0; m < opts.steps; m++) {
+        cfg << "      - echo bench-step " << m << "\n";
+    }
+
+    cfg << "jobs:\n";
+    for (size_t n = 0; n < opts.jobs; n++) {
+        cfg << "  job_" << n << ":\n";
+        cfg << "    image: " << image_name(n % opts.images) << "\n";
+        cfg << "    steps:\n";
+        cfg << "      - bench\n";
+    }
+}
+
+/// \brief Number of fake docker invocations by subcommand
+static std::map<std::string, size_t> count_spawns(const fs::path& log_path) {
+    std::map<std::string, size_t> out;
+    std::ifstream log(log_path.string());
+    std::string line;
+    while (std::getline(log, line)) {
+        out[line.substr(0, line.find(' '))]++;
+    }
+    return out;
+}
+
+static double seconds(const timeval& tv) {
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+}
+
+static long max_rss_kib(const rusage& usage) {
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+int main(int argc, char** argv) {
+    bench_options opts;
+    bool keep = false;
+    bool verbose = false;
+
+    po::options_description desc("dockerpack-bench: run builder over synthetic config with fake docker binary");
+    desc.add_options()("help,h", "Print this help");
+    desc.add_options()("jobs,n", po::value<size_t>(&opts.jobs)->default_value(opts.jobs), "Number of jobs in config");
+    desc.add_options()("steps,m", po::value<size_t>(&opts.steps)->default_value(opts.steps), "Number of steps in every job");
+    desc.add_options()("copies,k", po::value<size_t>(&opts.copies)->default_value(opts.copies), "Number of copied directories");
+    desc.add_options()("files", po::value<size_t>(&opts.files)->default_value(opts.files), "Number of files in every copied directory");
+    desc.add_options()("file-size", po::value<size_t>(&opts.file_size)->default_value(opts.file_size), "Size of every copied file in bytes");
+    desc.add_options()("images", po::value<size_t>(&opts.images)->default_value(opts.images), "Number of distinct job images");
+    desc.add_options()("remote-images", po::value<size_t>(&opts.remote_images)->default_value(opts.remote_images), "Number of job images which are not local and pulled from fake registry");
+    desc.add_options()("pull-latency", po::value<size_t>(&opts.pull_ms)->default_value(opts.pull_ms), "Fake image pull duration, ms");
+    desc.add_options()("pull-jobs", po::value<size_t>(&opts.pull_jobs)->default_value(opts.pull_jobs), "Pull up to N images at the same time before build, 0 - pull on job start");
+    desc.add_options()("parallel,j", po::value<size_t>(&opts.parallel)->default_value(opts.parallel), "Run up to N jobs at the same time");
+    desc.add_options()("warm", po::value<size_t>(&opts.warm)->default_value(opts.warm), "Prepare containers of N next jobs in background");
+    desc.add_options()("latency", po::value<size_t>(&opts.latency_ms)->default_value(opts.latency_ms), "Fake docker response latency, ms");
+    desc.add_options()("exec-lines", po::value<size_t>(&opts.exec_lines)->default_value(opts.exec_lines), "Output lines printed by every step");
+    desc.add_options()("sync", "Copy directories with \"sync\" option");
+    desc.add_options()("docker-dir", po::value<std::string>(&opts.docker_dir), "Directory with fake docker binary");
+    desc.add_options()("keep", "Don't remove generated project directory");
+    desc.add_options()("verbose", "Print builder output");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cout << desc << std::endl;
+        return 1;
+    }
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    opts.sync = vm.count("sync");
+    keep = vm.count("keep");
+    verbose = vm.count("verbose");
+    if (opts.images == 0) {
+        opts.images = 1;
+    }
+
+    if (opts.docker_dir.empty() || !fs::exists(fs::path(opts.docker_dir) / "docker")) {
+        std::cerr << "Fake docker binary not found in \"" << opts.docker_dir << "\", set it with --docker-dir" << std::endl;
+        return 1;
+    }
+
+    const fs::path root = fs::temp_directory_path() / fs::unique_path("dockerpack-bench-%%%%-%%%%");
+    fs::create_directories(root);
+    write_project(root, opts);
+
+    std::stringstream images;
+    std::stringstream registry;
+    for (size_t i = 0; i < opts.images; i++) {
+        if (i + opts.remote_images < opts.images) {
+            images << (i == 0 ? "" : ",") << image_name(i);
+        }
+        registry << (i == 0 ? "" : ",") << image_name(i);
+    }
+    const char* path_env = std::getenv("PATH");
+    const std::string path = fs::absolute(opts.docker_dir).string() + (path_env ? ":" + std::string(path_env) : "");
+    const fs::path log_path = root / "docker.log";
+    setenv("PATH", path.c_str(), 1);
+    // bootstrap cache starts cold
+    setenv("XDG_CACHE_HOME", (root / "cache").c_str(), 1);
+    setenv("FAKE_DOCKER_LOG", log_path.c_str(), 1);
+    setenv("FAKE_DOCKER_IMAGES", images.str().c_str(), 1);
+    setenv("FAKE_DOCKER_REGISTRY", registry.str().c_str(), 1);
+    setenv("FAKE_DOCKER_PULLED", (root / "pulled").c_str(), 1);
+    setenv("FAKE_DOCKER_PULL_MS", std::to_string(opts.pull_ms).c_str(), 1);
+    setenv("FAKE_DOCKER_LATENCY_MS", std::to_string(opts.latency_ms).c_str(), 1);
+    setenv("FAKE_DOCKER_EXEC_LINES", std::to_string(opts.exec_lines).c_str(), 1);
+    if (chdir(root.c_str()) != 0) {
+        std::cerr << "Unable to change directory to " << root.string() << std::endl;
+        return 1;
+    }
+
+    dockerpack::build_options build_opts;
+    build_opts.jobs = opts.parallel;
+    build_opts.warm = opts.warm;
+    build_opts.pull_jobs = opts.pull_jobs;
+    build_opts.sync = opts.sync;
+
+    std::streambuf* cout_buf = std::cout.rdbuf();
+    std::ofstream null_out;
+    if (!verbose) {
+        std::cout.rdbuf(null_out.rdbuf());
+    }
+
+    bool ret = false;
+    const auto started = std::chrono::steady_clock::now();
+    try {
+        dockerpack::builder b(root.string(), (root / "dockerpack.yml").string(), (root / dockerpack::STATE_FILE).string(), std::move(build_opts));
+        b.init();
+        ret = b.build_all();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+    const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout.rdbuf(cout_buf);
+
+    rusage self{};
+    rusage children{};
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+
+    const auto spawns = count_spawns(log_path);
+    size_t total_spawns = 0;
+    for (const auto& kv : spawns) {
+        total_spawns += kv.second;
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "config:       " << opts.jobs << " jobs x " << opts.steps << " steps x " << opts.copies << " copy paths ("
+              << opts.files << " files of " << opts.file_size << " bytes)" << std::endl;
+    std::cout << "parallel:     " << opts.parallel << ", warm " << opts.warm << ", latency " << opts.latency_ms << " ms" << (opts.sync ? ", sync" : "") << std::endl;
+    std::cout << "pull:         " << opts.remote_images << " of " << opts.images << " images, " << opts.pull_ms << " ms, " << opts.pull_jobs << " at once" << std::endl;
+    std::cout << "result:       " << (ret ? "success" : "failed") << std::endl;
+    std::cout << "wall time:    " << wall << " s" << std::endl;
+    std::cout << "cpu time:     user " << seconds(self.ru_utime) << " s, sys " << seconds(self.ru_stime) << " s" << std::endl;
+    std::cout << "spawns:       " << total_spawns << " (" << (opts.jobs ? (double) total_spawns / (double) opts.jobs : 0.0) << " per job)" << std::endl;
+    for (const auto& kv : spawns) {
+        std::cout << "  " << std::left << std::setw(12) << kv.first << std::right << kv.second << std::endl;
+    }
+    std::cout << "peak rss:     " << max_rss_kib(self) << " KiB (largest child " << max_rss_kib(children) << " KiB)" << std::endl;
+
+    if (keep) {
+        std::cout << "project:      " << root.string() << std::endl;
+    } else {
+        boost::system::error_code ec;
+        fs::remove_all(root, ec);
+    }
+
+    return ret ? 0 : 1;
+}
@@ -0,0 +1,465 @@
+/*!
+ * dockerpack.
+ * archive.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "archive.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <zstd.h>
+
+namespace fs = boost::filesystem;
+
+static const size_t TAR_BLOCK = 512;
+// max value of 11 octal digits
+static const uint64_t TAR_MAX_OCTAL = 077777777777ULL;
+// files up to this size are read ahead by worker threads, bigger ones are streamed by archive writer
+static const uint64_t READ_AHEAD_FILE_SIZE = 1024 * 1024;
+// limits of data read ahead of archive writer
+static const size_t READ_AHEAD_ENTRIES = 1024;
+static const uint64_t READ_AHEAD_BYTES = 64 * 1024 * 1024;
+
+std::string dockerpack::trim_directory(const std::string& path) {
+    std::string out = path;
+    while (out.size() > 1 && (out.back() == '/' || (out.size() > 2 && out.compare(out.size() - 2, 2, "/.") == 0))) {
+        out.pop_back();
+    }
+    return out;
+}
+
+bool dockerpack::stat_entry(const std::string& path, file_entry& entry) {
+    struct stat st {};
+    if (::lstat(path.c_str(), &st) != 0) {
+        return false;
+    }
+
+    if (S_ISREG(st.st_mode)) {
+        entry.type = '0';
+        entry.size = (uint64_t) st.st_size;
+    } else if (S_ISDIR(st.st_mode)) {
+        entry.type = '5';
+    } else if (S_ISLNK(st.st_mode)) {
+        entry.type = '2';
+    } else {
+        return false;
+    }
+    entry.mode = st.st_mode & 07777;
+    entry.mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+dockerpack::file_tree_t dockerpack::scan_directory(const std::string& root, const ignore_rules& rules) {
+    file_tree_t out;
+    const size_t root_len = root.size() + 1;
+    for (fs::recursive_directory_iterator it(root), end; it != end; ++it) {
+        const std::string path = it->path().string();
+        file_entry entry;
+        if (!stat_entry(path, entry)) {
+            continue;
+        }
+
+        std::string rel = path.substr(root_len);
+        if (rules.ignored(rel, entry.type == '5')) {
+            if (entry.type == '5') {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        out.emplace(std::move(rel), entry);
+    }
+    return out;
+}
+
+// tar
+
+static void write_octal(char* field, size_t field_size, uint64_t value) {
+    // field is terminated by NUL
+    snprintf(field, field_size, "%0*llo", (int) field_size - 1, (unsigned long long) value);
+}
+
+static std::string pax_record(const std::string& key, const std::string& value) {
+    // record length includes it's own decimal representation
+    const size_t payload = key.size() + value.size() + 3;
+    size_t length = payload + 1;
+    while (std::to_string(length).size() + payload != length) {
+        length = std::to_string(length).size() + payload;
+    }
+    return std::to_string(length) + " " + key + "=" + value + "\n";
+}
+
+dockerpack::tar_writer::tar_writer(std::ostream& out)
+    : m_out(out) {
+}
+
+void dockerpack::tar_writer::pad(uint64_t size) {
+    static const char zeros[TAR_BLOCK] = {0};
+    const size_t rest = size % TAR_BLOCK;
+    if (rest) {
+        m_out.write(zeros, TAR_BLOCK - rest);
+    }
+}
+
+void dockerpack::tar_writer::write_pax_header(const std::string& name, const std::string& link) {
+    std::string records = pax_record("path", name);
+    if (!link.empty()) {
+        records += pax_record("linkpath", link);
+    }
+    write_header("PaxHeaders/" + name.substr(0, 80), 'x', 0644, records.size(), 0, "");
+    m_out.write(records.data(), records.size());
+    pad(records.size());
+}
+
+void dockerpack::tar_writer::write_header(const std::string& name, char type, uint32_t mode, uint64_t size, int64_t mtime, const std::string& link) {
+    char header[TAR_BLOCK];
+    std::memset(header, 0, TAR_BLOCK);
+
+    // name[100] can be continued by prefix[155] at the directory separator
+    if (name.size() <= 100) {
+        std::memcpy(header, name.data(), name.size());
+    } else {
+        const size_t split = name.rfind('/', 155);
+        std::memcpy(header, name.data() + split + 1, name.size() - split - 1);
+        std::memcpy(header + 345, name.data(), split);
+    }
+    write_octal(header + 100, 8, mode);
+    write_octal(header + 108, 8, 0);
+    write_octal(header + 116, 8, 0);
+    write_octal(header + 124, 12, size);
+    write_octal(header + 136, 12, (uint64_t) std::max<int64_t>(mtime, 0));
+    header[156] = type;
+    std::memcpy(header + 157, link.data(), std::min<size_t>(link.size(), 100));
+    std::memcpy(header + 257, "ustar", 6);
+    std::memcpy(header + 263, "00", 2);
+
+    // checksum is calculated with checksum field filled with spaces
+    std::memset(header + 148, ' ', 8);
+    unsigned int checksum = 0;
+    for (char c : header) {
+        checksum += (unsigned char) c;
+    }
+    snprintf(header + 148, 8, "%06o", checksum);
+    header[155] = ' ';
+
+    m_out.write(header, TAR_BLOCK);
+}
+
+void dockerpack::tar_writer::write_entry_header(const std::string& name, const file_entry& entry, const std::string& link) {
+    bool fits_ustar = name.size() <= 100 && link.size() <= 100;
+    if (!fits_ustar && name.size() <= 255 && link.size() <= 100) {
+        const size_t split = name.rfind('/', 155);
+        fits_ustar = split != std::string::npos && split > 0 && name.size() - split - 1 <= 100;
+    }
+    if (!fits_ustar) {
+        write_pax_header(name, link);
+    }
+    if (entry.size > TAR_MAX_OCTAL) {
+        throw std::runtime_error("File is too large to archive: " + name);
+    }
+
+    const uint64_t size = entry.type == '0' ? entry.size : 0;
+    write_header(fits_ustar ? name : name.substr(0, 100), entry.type, entry.mode, size, entry.mtime / 1000000000, link.substr(0, 100));
+}
+
+void dockerpack::tar_writer::add(const std::string& name, const file_entry& entry, const std::string& local_path) {
+    if (entry.type == '2') {
+        add(name, entry, local_path, fs::read_symlink(local_path).string());
+        return;
+    }
+
+    write_entry_header(name, entry, "");
+    if (entry.type != '0') {
+        return;
+    }
+
+    std::ifstream is(local_path, std::ios::in | std::ios::binary);
+    if (!is.is_open()) {
+        throw std::runtime_error("Unable to read " + local_path);
+    }
+    // file could be changed after scanning: write exactly scanned size
+    char buffer[64 * 1024];
+    uint64_t left = entry.size;
+    while (left > 0 && is) {
+        is.read(buffer, (std::streamsize) std::min<uint64_t>(sizeof(buffer), left));
+        m_out.write(buffer, is.gcount());
+        left -= (uint64_t) is.gcount();
+    }
+    if (left > 0) {
+        std::memset(buffer, 0, sizeof(buffer));
+        while (left > 0) {
+            const size_t n = (size_t) std::min<uint64_t>(sizeof(buffer), left);
+            m_out.write(buffer, n);
+            left -= n;
+        }
+    }
+    pad(entry.size);
+}
+
+void dockerpack::tar_writer::add(const std::string& name, const file_entry& entry, const std::string&, const std::string& content) {
+    if (entry.type == '2') {
+        write_entry_header(name, entry, content);
+        return;
+    }
+
+    write_entry_header(name, entry, "");
+    if (entry.type != '0') {
+        return;
+    }
+    // file could be changed after scanning: write exactly scanned size
+    m_out.write(content.data(), (std::streamsize) std::min<uint64_t>(content.size(), entry.size));
+    for (uint64_t i = content.size(); i < entry.size; i++) {
+        m_out.put('\0');
+    }
+    pad(entry.size);
+}
+
+void dockerpack::tar_writer::finish() {
+    static const char zeros[TAR_BLOCK * 2] = {0};
+    m_out.write(zeros, sizeof(zeros));
+    m_out.flush();
+}
+
+// zstd
+
+namespace {
+
+/// \brief Compresses everything written to it with zstd and writes result to sink stream
+class zstd_streambuf : public std::streambuf {
+public:
+    zstd_streambuf(std::ostream& sink, int level, size_t threads)
+        : m_sink(sink),
+          m_ctx(ZSTD_createCCtx()),
+          m_in(ZSTD_CStreamInSize()),
+          m_out(ZSTD_CStreamOutSize()) {
+        if (!m_ctx) {
+            throw std::runtime_error("Unable to create zstd context");
+        }
+        ZSTD_CCtx_setParameter(m_ctx, ZSTD_c_compressionLevel, level);
+        if (threads > 1) {
+            // ignored if zstd is built without multithreading support
+            ZSTD_CCtx_setParameter(m_ctx, ZSTD_c_nbWorkers, (int) threads);
+        }
+        setp(m_in.data(), m_in.data() + m_in.size());
+    }
+    ~zstd_streambuf() override {
+        ZSTD_freeCCtx(m_ctx);
+    }
+
+    /// \brief Compress the rest of data and write zstd frame end
+    void finish() {
+        compress(ZSTD_e_end);
+        m_sink.flush();
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        compress(ZSTD_e_continue);
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        compress(ZSTD_e_continue);
+        return m_sink ? 0 : -1;
+    }
+
+private:
+    void compress(ZSTD_EndDirective mode) {
+        ZSTD_inBuffer input{pbase(), (size_t) (pptr() - pbase()), 0};
+        bool done = false;
+        while (!done) {
+            ZSTD_outBuffer output{m_out.data(), m_out.size(), 0};
+            const size_t remaining = ZSTD_compressStream2(m_ctx, &output, &input, mode);
+            if (ZSTD_isError(remaining)) {
+                throw std::runtime_error(std::string("zstd: ") + ZSTD_getErrorName(remaining));
+            }
+            m_sink.write(m_out.data(), (std::streamsize) output.pos);
+            done = mode == ZSTD_e_end ? remaining == 0 : input.pos == input.size;
+        }
+        setp(m_in.data(), m_in.data() + m_in.size());
+    }
+
+    std::ostream& m_sink;
+    ZSTD_CCtx* m_ctx;
+    std::vector<char> m_in;
+    std::vector<char> m_out;
+};
+
+} // namespace
+
+// archive
+
+static void write_tar_sequential(std::ostream& out, const std::string& root, const dockerpack::file_tree_t& tree, const std::vector<std::string>& names, const std::string& prefix) {
+    dockerpack::tar_writer tar(out);
+    for (const auto& rel : names) {
+        const dockerpack::file_entry& entry = tree.at(rel);
+        tar.add(prefix + (entry.type == '5' ? rel + "/" : rel), entry, root + "/" + rel);
+        if (!out) {
+            throw std::runtime_error("Archive stream is closed");
+        }
+    }
+    tar.finish();
+}
+
+static void write_tar_parallel(std::ostream& out, const std::string& root, const dockerpack::file_tree_t& tree, const std::vector<std::string>& names, const std::string& prefix, size_t threads) {
+    struct slot {
+        bool ready = false;
+        bool prefetched = false;
+        std::string content;
+        std::exception_ptr error;
+    };
+
+    std::vector<slot> slots(names.size());
+    std::mutex lock;
+    std::condition_variable ready_cv;
+    std::condition_variable space_cv;
+    size_t next = 0;
+    size_t written = 0;
+    uint64_t bytes_ahead = 0;
+    bool stopped = false;
+
+    const auto reader = [&]() {
+        while (true) {
+            size_t i;
+            bool prefetch;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                space_cv.wait(guard, [&] {
+                    return stopped || next >= names.size() || (next < written + READ_AHEAD_ENTRIES && bytes_ahead < READ_AHEAD_BYTES);
+                });
+                if (stopped || next >= names.size()) {
+                    return;
+                }
+                i = next++;
+                const dockerpack::file_entry& entry = tree.at(names[i]);
+                prefetch = entry.type == '2' || (entry.type == '0' && entry.size <= READ_AHEAD_FILE_SIZE);
+                if (prefetch) {
+                    bytes_ahead += entry.size;
+                }
+            }
+
+            std::string content;
+            std::exception_ptr error;
+            if (prefetch) {
+                const std::string path = root + "/" + names[i];
+                try {
+                    if (tree.at(names[i]).type == '2') {
+                        content = fs::read_symlink(path).string();
+                    } else {
+                        std::ifstream is(path, std::ios::in | std::ios::binary);
+                        if (!is.is_open()) {
+                            throw std::runtime_error("Unable to read " + path);
+                        }
+                        content.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            slots[i].content = std::move(content);
+            slots[i].error = error;
+            slots[i].prefetched = prefetch;
+            slots[i].ready = true;
+            ready_cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> readers;
+    readers.reserve(threads);
+    for (size_t i = 0; i < threads; i++) {
+        readers.emplace_back(reader);
+    }
+    const auto stop = [&]() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopped = true;
+        }
+        space_cv.notify_all();
+        for (auto& t : readers) {
+            t.join();
+        }
+    };
+
+    try {
+        dockerpack::tar_writer tar(out);
+        for (size_t i = 0; i < names.size(); i++) {
+            slot current;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                ready_cv.wait(guard, [&] { return slots[i].ready; });
+                current = std::move(slots[i]);
+            }
+            if (current.error) {
+                std::rethrow_exception(current.error);
+            }
+
+            const std::string& rel = names[i];
+            const dockerpack::file_entry& entry = tree.at(rel);
+            const std::string name = prefix + (entry.type == '5' ? rel + "/" : rel);
+            if (current.prefetched) {
+                tar.add(name, entry, root + "/" + rel, current.content);
+            } else {
+                tar.add(name, entry, root + "/" + rel);
+            }
+            if (!out) {
+                throw std::runtime_error("Archive stream is closed");
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                written = i + 1;
+                if (current.prefetched) {
+                    bytes_ahead -= entry.size;
+                }
+            }
+            space_cv.notify_all();
+        }
+        tar.finish();
+    } catch (...) {
+        stop();
+        throw;
+    }
+    stop();
+}
+
+void dockerpack::write_archive(std::ostream& out, const std::string& root, const file_tree_t& tree, const std::vector<std::string>& names, const std::string& prefix, const archive_options& opts) {
+    const auto write_tar = [&](std::ostream& tar_out) {
+        if (opts.threads > 1 && names.size() > 1) {
+            write_tar_parallel(tar_out, root, tree, names, prefix, opts.threads);
+        } else {
+            write_tar_sequential(tar_out, root, tree, names, prefix);
+        }
+    };
+
+    if (opts.compression.empty() || opts.compression == "none") {
+        write_tar(out);
+    } else if (opts.compression == "zstd") {
+        zstd_streambuf buf(out, opts.compression_level, opts.threads);
+        std::ostream zstd_out(&buf);
+        zstd_out.exceptions(std::ios::badbit);
+        write_tar(zstd_out);
+        zstd_out.flush();
+        buf.finish();
+    } else {
+        throw std::runtime_error("Unknown archive compression \"" + opts.compression + "\". Available: none, zstd");
+    }
+
+    if (!out) {
+        throw std::runtime_error("Archive stream is closed");
+    }
+}
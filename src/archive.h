@@ -0,0 +1,94 @@
+/*!
+ * dockerpack.
+ * archive.h
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#ifndef DOCKERPACK_ARCHIVE_H
+#define DOCKERPACK_ARCHIVE_H
+
+#include "data.h"
+#include "ignore.h"
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace dockerpack {
+
+struct file_entry {
+    // tar type flag: '0' - regular file, '5' - directory, '2' - symlink
+    char type = '0';
+    uint32_t mode = 0;
+    uint64_t size = 0;
+    // nanoseconds
+    int64_t mtime = 0;
+    // digest of file content or symlink target, empty for directory. Calculated only by dir_sync
+    digest_t hash{};
+
+    /// \brief Entry has the same metadata, so it's content is not hashed again
+    bool same_stat(const file_entry& other) const {
+        return type == other.type && mode == other.mode && size == other.size && mtime == other.mtime;
+    }
+};
+
+// relative path -> entry. Sorted, so directory always goes before it's content
+using file_tree_t = std::map<std::string, file_entry>;
+
+/// \brief Directory path without trailing "/" and "/.": "dir/." and "dir/" are the same as "dir"
+std::string trim_directory(const std::string& path);
+
+/// \brief Read metadata of local path without following symlink
+/// \return false if path does not exist or it's not a regular file, directory or symlink
+bool stat_entry(const std::string& path, file_entry& entry);
+
+/// \brief Collect entries of local directory. Ignored entries are skipped, ignored directories are not scanned.
+/// Sockets, fifos and devices are skipped too.
+file_tree_t scan_directory(const std::string& root, const ignore_rules& rules);
+
+/// \brief Minimal POSIX ustar writer. Paths longer than ustar limits are written with pax extended header.
+class tar_writer {
+public:
+    explicit tar_writer(std::ostream& out);
+
+    /// \param name path inside archive
+    /// \param local_path file to read content or symlink target from
+    void add(const std::string& name, const file_entry& entry, const std::string& local_path);
+    /// \brief Add regular file or symlink which content (link target) is already read
+    void add(const std::string& name, const file_entry& entry, const std::string& local_path, const std::string& content);
+    /// \brief Write end of archive: two zero blocks
+    void finish();
+
+private:
+    void write_entry_header(const std::string& name, const file_entry& entry, const std::string& link);
+    void write_header(const std::string& name, char type, uint32_t mode, uint64_t size, int64_t mtime, const std::string& link);
+    void write_pax_header(const std::string& name, const std::string& link);
+    void pad(uint64_t size);
+
+    std::ostream& m_out;
+};
+
+struct archive_options {
+    // threads reading files ahead of archive writer and zstd workers
+    size_t threads = 1;
+    // "none" or "zstd"
+    std::string compression = "none";
+    int compression_level = 3;
+};
+
+/// \brief Write tar stream of directory entries, optionally compressed.
+/// Files are read ahead by worker threads, archive is written in the order of names.
+/// \param root local directory
+/// \param tree scanned entries of root
+/// \param names entries of tree to write
+/// \param prefix prepended to every name inside archive, empty or ending with "/"
+/// \throws std::runtime_error if output stream is closed
+void write_archive(std::ostream& out, const std::string& root, const file_tree_t& tree, const std::vector<std::string>& names, const std::string& prefix, const archive_options& opts);
+
+} // namespace dockerpack
+
+#endif //DOCKERPACK_ARCHIVE_H
@@ -8,18 +8,53 @@
  */
 #include "builder.h"
 
+#include "output.h"
+#include "scheduler.h"
+#include "trace.h"
+
+#include <boost/filesystem.hpp>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <future>
 #include <termcolor/termcolor.hpp>
+#include <thread>
 #include <toolbox/strings.hpp>
 
 namespace style = termcolor;
 
 const std::string dockerpack::STATE_FILE = "dockerpack.lock";
 
-static inline void error(const std::string& message, const std::exception& e) {
-    std::cerr << style::red << message << ":" << std::endl;
-    std::cerr << e.what() << style::reset << std::endl;
+static inline void error(const std::string& message, const std::exception& e, const std::string& prefix = "") {
+    dockerpack::output(prefix, std::cerr) << style::red << message << ":" << std::endl
+                                          << e.what() << style::reset << std::endl;
 }
 
+static std::string step_label(const dockerpack::step_ptr_t& step) {
+    return step->name.empty() ? step->command : step->name;
+}
+
+/// \brief Job is registered as running while it's built, so builder::cancel() can interrupt it
+class running_job {
+public:
+    running_job(std::mutex& lock, std::unordered_set<dockerpack::job_ptr_t>& jobs, dockerpack::job_ptr_t job)
+        : m_lock(lock),
+          m_jobs(jobs),
+          m_job(std::move(job)) {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_jobs.insert(m_job);
+    }
+    ~running_job() {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_jobs.erase(m_job);
+    }
+
+private:
+    std::mutex& m_lock;
+    std::unordered_set<dockerpack::job_ptr_t>& m_jobs;
+    dockerpack::job_ptr_t m_job;
+};
+
 dockerpack::builder::builder(std::string cwd, const std::string& config_path, const std::string& state_file_path, build_options&& opts)
     : m_config(std::make_shared<dockerpack::config>(std::move(cwd), config_path)),
       m_docker(m_config),
@@ -29,27 +64,52 @@ dockerpack::builder::builder(std::string cwd, const std::string& config_path, co
     m_state.enable(!opts.stateless);
 }
 
-static std::vector<dockerpack::job_ptr_t> filter_jobs(const std::string& filter, const std::vector<dockerpack::job_ptr_t>& source) {
-    if (filter.empty()) {
-        return source;
-    }
-    std::vector<dockerpack::job_ptr_t> out;
-    std::copy_if(source.begin(), source.end(), std::back_inserter(out), [&filter](dockerpack::job_ptr_t job) {
+/// \brief Job is selected if it's name or image contains filter, or doesn't contain it if filter starts with "!"
+static dockerpack::job_filter_t job_filter(const std::string& filter) {
+    return [filter](const dockerpack::job& job) {
         using namespace toolbox::strings;
+        if (filter.empty()) {
+            return true;
+        }
         bool found;
         if (filter.at(0) == '!') {
-            found = !has_substring(filter.substr(1), job->job_name()) && !has_substring(filter.substr(1), job->image);
+            found = !has_substring(filter.substr(1), job.job_name()) && !has_substring(filter.substr(1), job.image);
         } else {
-            found = has_substring(filter, job->job_name()) || has_substring(filter, job->image);
+            found = has_substring(filter, job.job_name()) || has_substring(filter, job.image);
         }
         return found;
-    });
+    };
+}
 
-    return out;
+static std::vector<dockerpack::job_ptr_t> filter_jobs(const std::string& filter, const dockerpack::config& cfg) {
+    return cfg.select_jobs(job_filter(filter));
+}
+
+static std::vector<dockerpack::imb_ptr_t> filter_images(const std::string& filter, const dockerpack::config& cfg) {
+    if (filter.empty()) {
+        return cfg.build_images;
+    }
+    std::vector<dockerpack::imb_ptr_t> images;
+    for (const auto& image : cfg.build_images) {
+        if (toolbox::strings::has_substring(filter, image->job_name())) {
+            images.push_back(image);
+        } else if (toolbox::strings::has_substring(filter, image->image)) {
+            images.push_back(image);
+        } else if (toolbox::strings::has_substring(filter, image->repo)) {
+            images.push_back(image);
+        }
+    }
+    return images;
+}
+
+/// \brief Docker image reference with explicit tag: image without tag is the "latest" one
+static std::string image_reference(const std::string& image) {
+    const auto repo_tag = dockerpack::split_image_reference(image);
+    return repo_tag.first + ":" + repo_tag.second;
 }
 
 void dockerpack::builder::print_jobs() {
-    std::vector<job_ptr_t> jobs = filter_jobs(m_options.filter_name, m_config->jobs);
+    std::vector<job_ptr_t> jobs = filter_jobs(m_options.filter_name, *m_config);
 
     if (!m_options.filter_name.empty() && jobs.empty()) {
         std::cout << "No one job found by filter \"" << m_options.filter_name << "\"" << std::endl;
@@ -86,180 +146,641 @@ void dockerpack::builder::print_jobs() {
     }
 }
 
-bool dockerpack::builder::build_images() {
-    std::vector<imb_ptr_t> images;
-    if (!m_options.filter_name.empty()) {
-        for (auto& image : m_config->build_images) {
-            if (toolbox::strings::has_substring(m_options.filter_name, image->job_name())) {
-                images.push_back(image->shared_from_this());
-            } else if (toolbox::strings::has_substring(m_options.filter_name, image->image)) {
-                images.push_back(image->shared_from_this());
-            } else if (toolbox::strings::has_substring(m_options.filter_name, image->repo)) {
-                images.push_back(image->shared_from_this());
+bool dockerpack::builder::build_image(const dockerpack::imb_ptr_t& image) {
+    const std::string prefix = output_prefix(image);
+
+    if (m_docker.has_image(image->full_name(), image->tag)) {
+        dockerpack::output(prefix) << "Skipping build " << style::green << image->full_name() << ":" << image->tag << style::reset << std::endl;
+        return true;
+    }
+
+    if (cancelled(image)) {
+        return false;
+    }
+    running_job running(m_running_lock, m_running, image);
+
+    dockerpack::output(prefix) << "Starting building image: " << style::green << image->name << style::reset << std::endl;
+    trace_track track(image->name);
+    trace_span image_span(image->name, "image");
+
+    image->add_envs(m_options.envs);
+
+    // run image
+    std::vector<digest_t> step_keys;
+    try {
+        trace_span span("start", "phase");
+        m_docker.run(image);
+        step_keys = m_docker.step_keys(image);
+    } catch (const std::exception& e) {
+        if (cancelled(image)) {
+            return false;
+        }
+        error("Failed to start job " + image->name, e, prefix);
+        return false;
+    }
+
+    // copy local sources to image
+    if (!m_config->copy_paths.empty()) {
+        for (const auto& copy_path : m_config->copy_paths) {
+            try {
+                trace_span span("copy", "phase", copy_path);
+                m_docker.copy(image, copy_path);
+            } catch (const std::exception& e) {
+                if (cancelled(image)) {
+                    return false;
+                }
+                error("Failed to copy " + copy_path, e, prefix);
+                return false;
             }
         }
-    } else {
-        std::for_each(m_config->build_images.begin(), m_config->build_images.end(), [&images](imb_ptr_t image) {
-            images.push_back(image->shared_from_this());
-        });
     }
-    for (auto& image : images) {
-        if (m_docker.has_image(image->full_name(), image->tag)) {
-            std::cout << "Skipping build " << style::green << image->full_name() << ":" << image->tag << style::reset << std::endl;
+
+    // execute commands
+    for (size_t i = 0; i < image->steps.size(); i++) {
+        const step_ptr_t& step = image->steps[i];
+        if (cancelled(image)) {
+            return false;
+        }
+        if (!step->name.empty()) {
+            dockerpack::output(prefix) << " - " << style::green << step->name << style::reset << std::endl;
+        } else {
+            dockerpack::output(prefix) << " - exec: " << style::green << step->command << style::reset << std::endl;
+        }
+        if (m_state.has_success_build_step(image, step_keys[i])) {
+            dockerpack::output(prefix) << "   - skipping..." << std::endl;
+            tracer::instance().instant("skip: " + step_label(step), "step");
             continue;
         }
 
-        std::cout << "Starting building image: " << style::green << image->name << style::reset << std::endl;
-
-        image->add_envs(m_options.envs);
-
-        // run image
+        const std::string log_path = step_log_path(image, i);
         try {
-            m_docker.run(image);
+            trace_span span(step_label(step), "step", step->command);
+            m_docker.exec(image, step, log_path);
+            m_state.add_success_build_step(image, step, step_keys[i]);
+            m_state.save();
         } catch (const std::exception& e) {
-            error("Failed to start job " + image->name, e);
+            if (cancelled(image)) {
+                return false;
+            }
+            std::stringstream ss;
+            ss << "Failed to execute command: " << step->command << "\nIn image " << image->image << std::endl;
+            error(ss.str(), e, prefix);
+            add_failure(image, step_label(step), log_path);
             return false;
         }
+    }
 
-        // copy local sources to image
-        if (!m_config->copy_paths.empty()) {
-            for (const auto& copy_path : m_config->copy_paths) {
-                try {
-                    m_docker.copy(image, copy_path);
-                } catch (const std::exception& e) {
-                    error("Failed to copy " + copy_path, e);
-                    return false;
-                }
-            }
+    // finalize, stop and remove container
+    try {
+        trace_span span("finish", "phase");
+        m_docker.commit(image);
+        m_docker.stop(image);
+        m_docker.rm(image);
+    } catch (const std::exception& e) {
+        error("Failed stop and remove docker image", e, prefix);
+        return false;
+    }
+
+    return true;
+}
+
+bool dockerpack::builder::build_images() {
+    const std::vector<imb_ptr_t> images = filter_images(m_options.filter_name, *m_config);
+    prefetch_images(false);
+
+    m_docker.prefix_output(m_options.jobs > 1);
+
+    // image depends on another one if it's built from it (image can be declared before or after it's source)
+    std::unordered_map<std::string, size_t> produced_by;
+    for (size_t i = 0; i < images.size(); i++) {
+        produced_by[image_reference(images[i]->full_name() + ":" + images[i]->tag)] = i;
+    }
+
+    dockerpack::scheduler images_scheduler(m_options.jobs, m_options.on_failure);
+    images_scheduler.on_cancel([this]() {
+        cancel();
+    });
+    for (size_t i = 0; i < images.size(); i++) {
+        const imb_ptr_t image = images[i];
+        std::vector<size_t> deps;
+        const std::string source = image_reference(image->image);
+        if (produced_by.count(source) && produced_by.at(source) != i) {
+            deps.push_back(produced_by.at(source));
         }
 
-        // execute commands
-        for (const auto& step : image->steps) {
-            if (!step->name.empty()) {
-                std::cout << " - " << style::green << step->name << style::reset << std::endl;
-            } else {
-                std::cout << " - exec: " << style::green << step->command << style::reset << std::endl;
-            }
-            if (m_state.has_success_build_step(image, step)) {
-                std::cout << "   - skipping..." << std::endl;
-                continue;
+        images_scheduler.add(
+            [this, image]() {
+                return build_image(image);
+            },
+            std::move(deps));
+    }
+
+    if (!images_scheduler.run()) {
+        print_failures();
+        return false;
+    }
+
+    std::cout << style::green << "All images are built!\n"
+              << style::reset
+              << std::endl;
+    return true;
+}
+
+void dockerpack::builder::prefetch_images(bool with_jobs) {
+    if (m_prefetched || m_options.pull_jobs == 0) {
+        return;
+    }
+    m_prefetched = true;
+
+    // images built by config are never pulled, even if they are not selected by filter
+    std::unordered_set<std::string> produced;
+    for (const auto& image : m_config->build_images) {
+        produced.insert(image_reference(image->full_name() + ":" + image->tag));
+    }
+
+    std::vector<std::string> sources;
+    std::unordered_set<std::string> seen;
+    const auto add_source = [this, &produced, &sources, &seen](const std::string& image) {
+        const std::string reference = image_reference(image);
+        if (produced.count(reference) || !seen.insert(reference).second) {
+            return;
+        }
+        if (!m_docker.has_image(reference)) {
+            sources.push_back(reference);
+        }
+    };
+    for (const auto& image : filter_images(m_options.filter_name, *m_config)) {
+        add_source(image->image);
+    }
+    if (with_jobs) {
+        // successful jobs are skipped by build_job(), so their images are not needed
+        const job_filter_t filter = job_filter(m_options.filter_name);
+        m_config->visit_jobs([this, &filter, &add_source](const dockerpack::job& job) {
+            if (filter(job) && !m_state.has_success_job(job)) {
+                add_source(job.image);
             }
+        });
+    }
+    if (sources.empty()) {
+        return;
+    }
 
+    trace_span span("prefetch", "phase");
+    std::cout << "Pulling " << sources.size() << " image(s)" << std::endl;
+    // failed pull is not fatal: job using the image reports error on start, if it's still missing
+    dockerpack::scheduler pull_scheduler(m_options.pull_jobs, failure_policy::keep_going);
+    for (const auto& reference : sources) {
+        pull_scheduler.add([this, reference]() {
             try {
-                m_docker.exec(image, step);
-                m_state.add_success_build_step(image, step);
-                m_state.save();
+                m_docker.pull(reference);
+                dockerpack::output() << " - pulled: " << style::green << reference << style::reset << std::endl;
             } catch (const std::exception& e) {
-                std::stringstream ss;
-                ss << "Failed to execute command: " << step->command << "\nIn image " << image->image << std::endl;
-                error(ss.str(), e);
+                error("Failed to pull image " + reference, e);
+            }
+            return true;
+        });
+    }
+    pull_scheduler.run();
+}
+
+std::string dockerpack::builder::output_prefix(const dockerpack::job_ptr_t& job) const {
+    if (m_options.jobs <= 1) {
+        return std::string();
+    }
+    return "[" + job->name + "] ";
+}
+
+bool dockerpack::builder::build_job(const dockerpack::job_ptr_t& job) {
+    const std::string prefix = output_prefix(job);
+
+    if (m_state.has_success_job(job)) {
+        dockerpack::output(prefix) << "Skipping successful job " << style::green << job->name << style::reset << std::endl;
+        return true;
+    }
+
+    if (cancelled(job)) {
+        return false;
+    }
+    running_job running(m_running_lock, m_running, job);
+
+    trace_track track(job->name);
+    trace_span job_span(job->name, "job");
+
+    // container is started by warm pool or here
+    std::future<job_start> warm = take_warm(job);
+    job_start started;
+    try {
+        started = warm.valid() ? warm.get() : prepare_job(job, prefix);
+    } catch (const prepare_error& e) {
+        if (cancelled(job)) {
+            return false;
+        }
+        error(e.message, e, prefix);
+        add_failure(job, e.step);
+        return false;
+    }
+    // preparation is stopped by cancel
+    if (cancelled(job)) {
+        return false;
+    }
+    const std::vector<digest_t>& step_keys = started.step_keys;
+    const size_t restored_steps = started.restored_steps;
+
+    // execute commands
+    for (size_t i = 0; i < job->steps.size(); i++) {
+        const step_ptr_t& step = job->steps[i];
+        if (cancelled(job)) {
+            return false;
+        }
+        if (!step->name.empty()) {
+            dockerpack::output(prefix) << " - " << style::green << step->name << style::reset << std::endl;
+        } else {
+            dockerpack::output(prefix) << " - exec: " << style::green << step->command << style::reset << std::endl;
+        }
+        if (i < restored_steps) {
+            dockerpack::output(prefix) << "   - restored from checkpoint" << std::endl;
+            tracer::instance().instant("restored: " + step_label(step), "step");
+            continue;
+        }
+        if (m_state.has_success_step(job, step_keys[i])) {
+            dockerpack::output(prefix) << "   - skipping..." << std::endl;
+            tracer::instance().instant("skip: " + step_label(step), "step");
+            continue;
+        }
+
+        const std::string log_path = step_log_path(job, i);
+        try {
+            const auto started = std::chrono::steady_clock::now();
+            {
+                trace_span span(step_label(step), "step", step->command);
+                m_docker.exec(job, step, log_path);
+            }
+            const auto elapsed = std::chrono::steady_clock::now() - started;
+            if (m_config->debug) {
+                dockerpack::output(prefix) << style::yellow << "[debug] add success step " << job->job_name() << " - " << step->to_string() << style::reset << std::endl;
+            }
+            m_state.add_success_step(job, step, step_keys[i]);
+            m_state.save();
+
+            const bool slow = m_config->checkpoint_after > 0 && elapsed >= std::chrono::seconds(m_config->checkpoint_after);
+            if (!m_options.stateless && checkpoints_enabled() && (step->checkpoint || slow)) {
+                checkpoint(job, step_keys[i]);
+            }
+        } catch (const std::exception& e) {
+            if (cancelled(job)) {
                 return false;
             }
+            std::stringstream ss;
+            ss << "Failed to execute command: " << style::green << step->command << style::reset << "\nIn job " << style::green << job->name << style::reset << std::endl;
+            error(ss.str(), e, prefix);
+            add_failure(job, step_label(step), log_path);
+            return false;
         }
+    }
 
-        // finalize, stop and remove container
+    // caches are shared by all jobs, it's enough to keep them in size after successful ones
+    try {
+        trace_span span("prune caches", "phase");
+        m_docker.prune_caches(job);
+    } catch (const std::exception& e) {
+        error("Failed to prune caches", e, prefix);
+    }
+
+    // finalize, stop and remove container
+    if (not m_options.no_cleanup) {
         try {
-            m_docker.commit(image);
-            m_docker.stop(image);
-            m_docker.rm(image);
+            trace_span span("finish", "phase");
+            m_docker.stop(job);
+            m_docker.rm(job);
         } catch (const std::exception& e) {
-            error("Failed stop and remove docker image", e);
+            error("Failed stop and remove docker image", e, prefix);
             return false;
         }
     }
 
-    std::cout << style::green << "All images are built!\n"
-              << style::reset
-              << std::endl;
+    // snapshots are needed only to resume failed job. If container is kept, it may use snapshot, so "cleanup" command removes them
+    if (not m_options.no_cleanup) {
+        for (const auto& image : m_state.remove_checkpoints(step_keys)) {
+            try {
+                m_docker.remove_image(image);
+            } catch (const std::exception& e) {
+                error("Failed to remove checkpoint image " + image, e, prefix);
+            }
+        }
+    }
+
+    m_state.add_success_job(job);
+    m_state.save();
     return true;
 }
-bool dockerpack::builder::build_jobs() {
-    std::vector<job_ptr_t> jobs = filter_jobs(m_options.filter_name, m_config->jobs);
-    if (jobs.empty()) {
-        std::cout << "Nothing to run: ";
-        if (!m_options.filter_name.empty()) {
-            std::cout << "no one job has found by name \"" << style::green << m_options.filter_name << style::reset << std::endl;
+
+dockerpack::builder::job_start dockerpack::builder::prepare_job(const dockerpack::job_ptr_t& job, const std::string& prefix) {
+    trace_track track(job->name);
+    job->add_envs(m_options.envs);
+
+    job_start out;
+    // step chain keys depend on image id, so they can be resolved only if image is pulled
+    bool keys_resolved = false;
+
+    // run image
+    try {
+        trace_span span("start", "phase");
+        if (m_options.stateless && m_docker.has_running_job(job)) {
+            m_docker.stop(job);
+            m_docker.rm(job);
+        }
+
+        // container is gone: start from the newest snapshot which matches current steps chain
+        std::string snapshot;
+        if (!m_docker.has_running_job(job) && m_docker.has_image(job->image)) {
+            out.step_keys = m_docker.step_keys(job);
+            keys_resolved = true;
+            // overlay workspace layer is not committed to snapshot, so it can't be restored
+            for (size_t i = checkpoints_enabled() ? out.step_keys.size() : 0; i > 0; i--) {
+                const std::string image = m_state.get_checkpoint(out.step_keys[i - 1]);
+                if (!image.empty() && m_docker.has_image(image)) {
+                    snapshot = image;
+                    out.restored_steps = i;
+                    break;
+                }
+            }
+        }
+
+        if (snapshot.empty()) {
+            dockerpack::output(prefix) << "Starting job: " << style::green << job->name << style::reset << std::endl;
         } else {
-            std::cout << "job list is empty" << std::endl;
+            dockerpack::output(prefix) << "Starting job: " << style::green << job->name << style::reset
+                                       << " from checkpoint " << style::green << snapshot << style::reset << std::endl;
         }
 
-        return true;
+        // cancelled build must not wait for preparations of jobs which will not run
+        if (m_cancelled) {
+            return out;
+        }
+        out.created = m_docker.run(job, snapshot);
+        if (out.created) {
+            // results of steps executed in previous container are lost
+            m_state.reset_success_steps(job);
+        }
+        if (!keys_resolved) {
+            out.step_keys = m_docker.step_keys(job);
+        }
+    } catch (const std::exception& e) {
+        throw prepare_error("Failed to start job " + job->name, "start", e);
     }
-    for (auto& job : jobs) {
-        if (m_state.has_success_job(job)) {
-            std::cout << "Skipping successful job " << style::green << job->name << style::reset << std::endl;
+
+    // copy local sources to image
+    for (const auto& copy_path : m_config->copy_paths) {
+        if (m_cancelled) {
+            return out;
+        }
+        try {
+            dockerpack::output(prefix) << " - copy: " << style::green << copy_path << style::reset << std::endl;
+            trace_span span("copy", "phase", copy_path);
+            m_docker.copy(job, copy_path);
+        } catch (const std::exception& e) {
+            throw prepare_error("Failed to copy " + copy_path, "copy " + copy_path, e);
+        }
+    }
+
+    return out;
+}
+
+void dockerpack::builder::warm_up(size_t from) {
+    std::lock_guard<std::mutex> lock(m_warm_lock);
+    const size_t to = std::min(from + m_options.warm, m_warm_queue.size());
+    for (size_t i = from; i < to; i++) {
+        const job_ptr_t job = m_warm_queue[i];
+        // already prepared or claimed by worker, which prepares it itself if it's not ready
+        if (!m_warm_seen.insert(job).second) {
+            continue;
+        }
+        if (m_cancelled || m_state.has_success_job(job)) {
             continue;
         }
+        // output of background preparation is always prefixed, as it's mixed with output of running job
+        m_warm[job] = std::async(std::launch::async, [this, job]() {
+            return prepare_job(job, "[" + job->name + "] ");
+        });
+    }
+}
+
+void dockerpack::builder::claim_warm(const dockerpack::job_ptr_t& job) {
+    std::lock_guard<std::mutex> lock(m_warm_lock);
+    m_warm_seen.insert(job);
+}
 
-        job->add_envs(m_options.envs);
+std::future<dockerpack::builder::job_start> dockerpack::builder::take_warm(const dockerpack::job_ptr_t& job) {
+    std::lock_guard<std::mutex> lock(m_warm_lock);
+    auto it = m_warm.find(job);
+    if (it == m_warm.end()) {
+        return std::future<job_start>();
+    }
+    std::future<job_start> out = std::move(it->second);
+    m_warm.erase(it);
+    return out;
+}
+
+void dockerpack::builder::drain_warm() {
+    std::unordered_map<job_ptr_t, std::future<job_start>> left;
+    {
+        std::lock_guard<std::mutex> lock(m_warm_lock);
+        left.swap(m_warm);
+        m_warm_queue.clear();
+        m_warm_seen.clear();
+    }
 
-        // run image
+    // build is stopped before these jobs: remove containers created for them, resumable ones are kept
+    for (auto& kv : left) {
         try {
-            if (m_options.stateless && m_docker.has_running_job(job)) {
-                m_docker.stop(job);
-                m_docker.rm(job);
+            if (kv.second.get().created) {
+                m_docker.stop(kv.first);
+                m_docker.rm(kv.first);
             }
-
-            std::cout << "Starting job: " << style::green << job->name << style::reset << std::endl;
-            m_docker.run(job);
         } catch (const std::exception& e) {
-            error("Failed to start job " + job->name, e);
-            return false;
+            error("Failed to remove prepared container of job " + kv.first->name, e);
         }
+    }
+}
 
-        // copy local sources to image
-        if (!m_config->copy_paths.empty()) {
-            for (const auto& copy_path : m_config->copy_paths) {
-                try {
-                    std::cout << " - copy: " << style::green << copy_path << style::reset << std::endl;
-                    m_docker.copy(job, copy_path);
-                } catch (const std::exception& e) {
-                    error("Failed to copy " + copy_path, e);
-                    return false;
-                }
-            }
+/// \brief Lowercase name usable as file name
+static std::string file_name_part(const std::string& value, size_t max_length) {
+    std::string out;
+    for (char c : value) {
+        if (out.size() >= max_length) {
+            break;
         }
+        if (std::isalnum((unsigned char) c) || c == '.' || c == '_') {
+            out.push_back((char) std::tolower((unsigned char) c));
+        } else if (!out.empty() && out.back() != '-') {
+            out.push_back('-');
+        }
+    }
+    while (!out.empty() && out.back() == '-') {
+        out.pop_back();
+    }
+    return out;
+}
 
-        // execute commands
-        for (const auto& step : job->steps) {
-            if (!step->name.empty()) {
-                std::cout << " - " << style::green << step->name << style::reset << std::endl;
-            } else {
-                std::cout << " - exec: " << style::green << step->command << style::reset << std::endl;
-            }
-            if (m_state.has_success_step(job, step)) {
-                std::cout << "   - skipping..." << std::endl;
-                continue;
-            }
+std::string dockerpack::builder::step_log_path(const dockerpack::job_ptr_t& job, size_t index) const {
+    if (m_config->log_dir.empty()) {
+        return "";
+    }
+    const step_ptr_t& step = job->steps.at(index);
+    std::string name = file_name_part(step_label(step), 40);
+    if (name.empty()) {
+        name = "step";
+    }
 
-            try {
-                m_docker.exec(job, step);
-                if (m_config->debug) {
-                    std::cout << style::yellow << "[debug] add success step " << job->job_name() << " - " << step->to_string() << style::reset << std::endl;
-                }
-                m_state.add_success_step(job, step);
-                m_state.save();
-            } catch (const std::exception& e) {
-                std::stringstream ss;
-                ss << "Failed to execute command: " << style::green << step->command << style::reset << "\nIn job " << style::green << job->name << style::reset << std::endl;
-                error(ss.str(), e);
-                return false;
-            }
+    char number[8];
+    snprintf(number, sizeof(number), "%02zu", index + 1);
+    boost::filesystem::path dir(m_config->log_dir);
+    if (dir.is_relative()) {
+        dir = boost::filesystem::path(m_config->m_cwd) / dir;
+    }
+    return (dir / file_name_part(job->name, 80) / (std::string(number) + "-" + name + ".log")).string();
+}
+
+void dockerpack::builder::add_failure(const dockerpack::job_ptr_t& job, const std::string& what, const std::string& log_path) {
+    std::lock_guard<std::mutex> lock(m_failures_lock);
+    m_failures.push_back({job->name, what, log_path});
+}
+
+void dockerpack::builder::print_failures() {
+    std::lock_guard<std::mutex> lock(m_failures_lock);
+    if (m_failures.empty() && m_cancelled_jobs.empty()) {
+        return;
+    }
+    dockerpack::output out("", std::cerr);
+    if (!m_failures.empty()) {
+        out << style::red << "\nFailed:" << style::reset << std::endl;
+    }
+    for (const auto& failure : m_failures) {
+        out << " - " << style::green << failure.job << style::reset << ": " << failure.step << std::endl;
+        if (!failure.log_path.empty()) {
+            out << "   log: " << failure.log_path << std::endl;
         }
+    }
+    if (!m_cancelled_jobs.empty()) {
+        out << style::yellow << "\nCancelled:" << style::reset << std::endl;
+    }
+    for (const auto& name : m_cancelled_jobs) {
+        out << " - " << style::green << name << style::reset << std::endl;
+    }
+}
+
+void dockerpack::builder::cancel() {
+    m_cancelled = true;
+    std::vector<job_ptr_t> jobs;
+    {
+        std::lock_guard<std::mutex> lock(m_running_lock);
+        jobs.assign(m_running.begin(), m_running.end());
+    }
+    if (jobs.empty()) {
+        return;
+    }
+
+    trace_span span("cancel", "phase");
+    dockerpack::output("", std::cerr) << style::red << "Cancelling " << jobs.size() << " running job(s)" << style::reset << std::endl;
+    dockerpack::exec_stream::terminate_all();
 
-        // finalize, stop and remove container
-        if (not m_options.no_cleanup) {
+    // command inside container is still running after "docker exec" is killed, so containers are stopped too.
+    // "docker stop" waits for graceful shutdown, all of them are stopped at the same time
+    std::vector<std::thread> stoppers;
+    stoppers.reserve(jobs.size());
+    for (const auto& job : jobs) {
+        stoppers.emplace_back([this, job]() {
             try {
-                m_docker.stop(job);
-                m_docker.rm(job);
+                m_docker.interrupt(job);
             } catch (const std::exception& e) {
-                error("Failed stop and remove docker image", e);
-                return false;
+                error("Failed to stop job " + job->name, e, output_prefix(job));
             }
-        }
+        });
+    }
+    for (auto& t : stoppers) {
+        t.join();
+    }
+}
+
+bool dockerpack::builder::cancelled(const dockerpack::job_ptr_t& job) {
+    if (!m_cancelled) {
+        return false;
+    }
+
+    const std::string prefix = output_prefix(job);
+    dockerpack::output(prefix) << style::yellow << "Cancelled job " << job->name << style::reset << std::endl;
+    // session is closed and container is removed in the job thread, as they may be still in use until now
+    try {
+        m_docker.stop(job);
+        m_docker.rm(job);
+    } catch (const std::exception& e) {
+        error("Failed stop and remove docker image", e, prefix);
+    }
+
+    std::lock_guard<std::mutex> lock(m_failures_lock);
+    m_cancelled_jobs.push_back(job->name);
+    return true;
+}
 
-        m_state.add_success_job(job);
+bool dockerpack::builder::checkpoints_enabled() const {
+    return m_config->workspace != "overlay";
+}
+
+void dockerpack::builder::checkpoint(const dockerpack::job_ptr_t& job, const dockerpack::digest_t& chain_key) {
+    trace_span span("checkpoint", "phase");
+    const std::string prefix = output_prefix(job);
+    try {
+        const std::string image = m_docker.checkpoint(job, to_hex(chain_key).substr(0, 16));
+        m_state.add_checkpoint(chain_key, image);
         m_state.save();
+        dockerpack::output(prefix) << "   - checkpoint: " << style::green << image << style::reset << std::endl;
+    } catch (const std::exception& e) {
+        // job can continue without snapshot
+        error("Failed to create checkpoint", e, prefix);
+    }
+}
+
+bool dockerpack::builder::build_jobs() {
+    std::vector<job_ptr_t> jobs = filter_jobs(m_options.filter_name, *m_config);
+    prefetch_images(true);
+    if (jobs.empty()) {
+        std::cout << "Nothing to run: ";
+        if (!m_options.filter_name.empty()) {
+            std::cout << "no one job has found by name \"" << style::green << m_options.filter_name << style::reset << std::endl;
+        } else {
+            std::cout << "job list is empty" << std::endl;
+        }
+
+        return true;
+    }
+
+    m_docker.prefix_output(m_options.jobs > 1);
+
+    {
+        std::lock_guard<std::mutex> lock(m_warm_lock);
+        m_warm_queue = jobs;
+    }
+
+    dockerpack::scheduler jobs_scheduler(m_options.jobs, m_options.on_failure);
+    jobs_scheduler.on_cancel([this]() {
+        cancel();
+    });
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const job_ptr_t job = jobs[i];
+        jobs_scheduler.add([this, job, i]() {
+            // scheduler starts jobs in order they are added, so the next ones are prepared while this one runs.
+            // With concurrent jobs the order is not strict: job is claimed first, so it's never prepared twice
+            claim_warm(job);
+            warm_up(i + 1);
+            return build_job(job);
+        });
+    }
+
+    const bool success = jobs_scheduler.run();
+    drain_warm();
+    if (!success) {
+        print_failures();
+        return false;
     }
 
     m_state.remove();
@@ -268,20 +789,31 @@ bool dockerpack::builder::build_jobs() {
 }
 
 void dockerpack::builder::init() {
-
-    if (!dockerpack::docker::check_docker_exists()) {
-        throw std::runtime_error("'docker' binary not found on your system. Please install it first or add to $PATH.");
-    }
-
     if (m_options.reset_lock) {
         m_state.remove();
     }
 
+    m_config->use_cache = m_options.config_cache;
     m_config->parse(m_options.copy_local);
+    if (!m_options.backend.empty()) {
+        m_config->backend = m_options.backend;
+    }
+    if (m_options.session) {
+        m_config->session = true;
+    }
+    if (m_options.sync) {
+        m_config->sync = true;
+    }
+
+    // throws if docker is not available
+    m_docker.init();
+    m_state.fsync(m_config->state_fsync);
     m_state.load();
 }
 
 bool dockerpack::builder::build_all() {
+    // sources of images and jobs are pulled together, before images are built
+    prefetch_images(true);
     if (!build_images()) {
         return false;
     }
@@ -296,10 +828,6 @@ bool dockerpack::builder::build_all() {
 bool dockerpack::builder::cleanup() {
     m_state.remove();
     auto jobs = m_docker.filter_running_job(m_options.filter_name);
-    if (jobs.empty()) {
-        std::cout << "Nothing to cleanup" << std::endl;
-        return true;
-    }
 
     size_t i = 0;
     for (const auto& j : jobs) {
@@ -308,7 +836,19 @@ bool dockerpack::builder::cleanup() {
         i++;
     }
 
-    std::cout << "Stopped and removed " << i << " images" << std::endl;
+    // snapshots can be removed only after containers started from them
+    const size_t checkpoints = m_docker.remove_checkpoints(m_options.filter_name);
+    if (jobs.empty() && !checkpoints) {
+        std::cout << "Nothing to cleanup" << std::endl;
+        return true;
+    }
+
+    if (i) {
+        std::cout << "Stopped and removed " << i << " images" << std::endl;
+    }
+    if (checkpoints) {
+        std::cout << "Removed " << checkpoints << " checkpoint images" << std::endl;
+    }
 
     return true;
 }
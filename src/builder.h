@@ -11,10 +11,17 @@
 
 #include "config.h"
 #include "docker.h"
+#include "scheduler.h"
 #include "state.h"
 
+#include <atomic>
+#include <future>
 #include <memory>
+#include <stdexcept>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace dockerpack {
@@ -27,6 +34,22 @@ struct build_options {
     bool stateless = false;
     bool no_cleanup = false;
     bool copy_local = false;
+    // max number of jobs running at the same time
+    size_t jobs = 1;
+    // overrides config docker backend if not empty
+    std::string backend;
+    // enables config "session" option
+    bool session = false;
+    // enables config "sync" option
+    bool sync = false;
+    // load parsed config from cache if config files are not changed
+    bool config_cache = true;
+    // what to do with other jobs (or images) when one of them has failed
+    failure_policy on_failure = failure_policy::stop;
+    // number of next jobs which containers are started and filled with sources in background while current jobs run
+    size_t warm = 0;
+    // max number of concurrent pulls of missing images before build, 0 disables prefetch
+    size_t pull_jobs = 4;
     env_map envs;
 };
 
@@ -42,10 +65,87 @@ public:
     bool cleanup();
 
 private:
+    /// \brief Job container which is ready to execute steps
+    struct job_start {
+        std::vector<digest_t> step_keys;
+        // steps before this index are restored from snapshot image
+        size_t restored_steps = 0;
+        // new container is created, not reused running one
+        bool created = false;
+    };
+
+    /// \brief Failed start or copy of job preparation
+    class prepare_error : public std::runtime_error {
+    public:
+        prepare_error(std::string message, std::string step, const std::exception& cause)
+            : std::runtime_error(cause.what()),
+              message(std::move(message)),
+              step(std::move(step)) {
+        }
+
+        std::string message;
+        // failure label: "start" or "copy <path>"
+        std::string step;
+    };
+
+    /// \brief Pull missing images of selected jobs and images to build at the same time, once per build.
+    /// Images produced by config build_images and images used only by successful jobs are not pulled
+    /// \param with_jobs pull images of jobs too, not only sources of images to build
+    void prefetch_images(bool with_jobs);
+    bool build_image(const imb_ptr_t& image);
+    bool build_job(const job_ptr_t& job);
+    /// \brief Start job container (or reuse running one, or resume from checkpoint) and copy local sources into it.
+    /// Returns early if build is cancelled, created container is marked in result anyway, so it can be removed
+    /// \throws prepare_error
+    job_start prepare_job(const job_ptr_t& job, const std::string& prefix);
+    /// \brief Prepare jobs of build queue [from, from + warm) in background, every job is prepared once
+    void warm_up(size_t from);
+    /// \brief Job is started by worker: warm_up() must not prepare it anymore
+    void claim_warm(const job_ptr_t& job);
+    /// \return background preparation of job or invalid future if it's not prepared in background
+    std::future<job_start> take_warm(const job_ptr_t& job);
+    /// \brief Wait for preparations which are not taken by jobs and remove their containers
+    void drain_warm();
+    /// \brief Commit job container to snapshot image which is used to resume job after it's container is removed
+    void checkpoint(const job_ptr_t& job, const digest_t& chain_key);
+    /// \brief Snapshots don't contain overlay workspace, so it's disabled in overlay mode
+    bool checkpoints_enabled() const;
+    std::string output_prefix(const job_ptr_t& job) const;
+    /// \return log file of job step or empty string if logs are disabled
+    std::string step_log_path(const job_ptr_t& job, size_t index) const;
+    void add_failure(const job_ptr_t& job, const std::string& what, const std::string& log_path = "");
+    /// \brief Print failed steps with their logs and cancelled jobs
+    void print_failures();
+    /// \brief Fail fast: interrupt all running jobs, they stop at the current step
+    void cancel();
+    /// \brief Must be checked by running job between and after steps
+    /// \return true if build is cancelled, in this case job container is removed and job is reported as cancelled
+    bool cancelled(const job_ptr_t& job);
+
+    struct failed_step {
+        std::string job;
+        std::string step;
+        std::string log_path;
+    };
+
     config_ptr_t m_config;
     dockerpack::docker m_docker;
     dockerpack::state m_state;
     dockerpack::build_options m_options;
+    bool m_prefetched = false;
+    // guards m_failures and m_cancelled_jobs
+    std::mutex m_failures_lock;
+    std::vector<failed_step> m_failures;
+    std::vector<std::string> m_cancelled_jobs;
+    std::atomic<bool> m_cancelled{false};
+    // jobs and images which are being built now
+    std::mutex m_running_lock;
+    std::unordered_set<job_ptr_t> m_running;
+    // guards warm pool: build queue, jobs which are prepared or claimed by workers and preparations
+    std::mutex m_warm_lock;
+    std::vector<job_ptr_t> m_warm_queue;
+    std::unordered_set<job_ptr_t> m_warm_seen;
+    std::unordered_map<job_ptr_t, std::future<job_start>> m_warm;
 };
 } // namespace dockerpack
 
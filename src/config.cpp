@@ -8,28 +8,172 @@
  */
 #include "config.h"
 
+#include "config_cache.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <fstream>
 #include <stdexcept>
 #include <toolbox/strings.hpp>
+#include <unordered_set>
+
+inline dockerpack::step_ptr_t create_step(dockerpack::step_arena& arena, std::string command, std::string name = "", bool skip_on_error = false, std::string workdir = "") {
+    dockerpack::step step;
+    step.command = std::move(command);
+    step.name = std::move(name);
+    step.skip_on_error = skip_on_error;
+    step.workdir = std::move(workdir);
+    return arena.intern(std::move(step));
+}
 
-inline dockerpack::step_ptr_t create_step(std::string command, std::string name = "", bool skip_on_error = false, std::string workdir = "") {
-    dockerpack::step_ptr_t step = std::make_shared<dockerpack::step>();
-    step->command = std::move(command);
-    step->name = std::move(name);
-    step->skip_on_error = skip_on_error;
-    step->workdir = std::move(workdir);
-    return step;
+static std::string default_docker_host() {
+    const char* host = std::getenv("DOCKER_HOST");
+    if (host != nullptr && toolbox::strings::has_substring("unix://", std::string(host))) {
+        return std::string(host).substr(7);
+    }
+    return "/var/run/docker.sock";
 }
 
 dockerpack::config::config(std::string cwd, std::string cfg_path)
     : cfg_path(std::move(cfg_path)),
+      backend("cli"),
+      docker_host(default_docker_host()),
       workdir("~/project"),
       m_cwd(std::move(cwd)) {
 }
 
 void dockerpack::config::parse(bool copy_local) {
-    const YAML::Node config = YAML::LoadFile(cfg_path);
+    config_cache cache(cfg_path, m_cwd, copy_local);
+    if (!use_cache || !cache.load(*this)) {
+        parse_yaml(copy_local);
+        if (use_cache) {
+            try {
+                cache.save(*this);
+            } catch (const std::exception&) {
+                // cache is an optimization only, next run will parse yaml again
+            }
+        }
+    }
+    resolve();
+    validate_workspace();
+}
+
+YAML::Node dockerpack::config::load_input(const std::string& path) {
+    std::ifstream is(path, std::ios::in | std::ios::binary);
+    if (!is.is_open()) {
+        throw std::runtime_error("Unable to open " + path);
+    }
+    std::stringstream ss;
+    ss << is.rdbuf();
+    // the same content is parsed and hashed, so cache can't get digest of newer file than parsed one
+    const std::string content = ss.str();
+    inputs.push_back({path, dockerpack::sha256(content)});
+    return YAML::Load(content);
+}
+
+/// \brief Absolute path without "~", "." and ".." segments and symlinks, so the same file is always the same string
+static std::string include_path(std::string path, const std::string& cwd) {
+    dockerpack::utils::normalize_path(path);
+    boost::filesystem::path p(path);
+    if (p.is_relative()) {
+        p = boost::filesystem::path(cwd) / p;
+    }
+    boost::system::error_code ec;
+    const boost::filesystem::path canonical = boost::filesystem::weakly_canonical(p, ec);
+    return ec ? p.lexically_normal().string() : canonical.string();
+}
+
+static void resolve_envs(dockerpack::env_map& envs) {
+    for (auto& kv : envs) {
+        if (toolbox::strings::equals_icase(kv.second, "$ENV")) {
+            const char* v = std::getenv(kv.first.c_str());
+            kv.second = v == nullptr ? std::string() : std::string(v);
+        }
+    }
+}
+
+void dockerpack::config::resolve() {
+    resolve_envs(global_envs);
+    // every step object is stored once, no matter how many jobs use it
+    for (auto& step : arena) {
+        resolve_envs(step.envs);
+        step.update_digest();
+    }
+    for (auto& job : jobs) {
+        resolve_envs(job->envs);
+    }
+    for (auto& image : build_images) {
+        resolve_envs(image->envs);
+    }
+    resolve_envs(matrix.envs);
+}
+
+void dockerpack::config::validate_workspace() const {
+    if (workspace != "mount") {
+        return;
+    }
+
+    // path inside container -> path inside project, empty if it's not under workdir
+    const auto project_path = [this](const std::string& path) -> std::string {
+        if (path == workdir) {
+            return m_cwd;
+        }
+        const std::string dir = workdir.back() == '/' ? workdir : workdir + "/";
+        if (path.compare(0, dir.size(), dir) == 0) {
+            return m_cwd + "/" + path.substr(dir.size());
+        }
+        return std::string();
+    };
+    const auto check_dir = [&project_path](const std::string& path, const std::string& section, const std::string& name) {
+        const std::string local = project_path(path);
+        if (!local.empty() && !boost::filesystem::is_directory(local)) {
+            throw config_parse_error("workspace mount is read-only, " + path + " does not exist in project and can't be created", section, name);
+        }
+    };
+
+    for (const auto& path : copy_paths) {
+        auto local_remote = toolbox::strings::split_pair(path, " ");
+        std::string remote = local_remote.second.empty() ? local_remote.first : local_remote.second;
+        toolbox::strings::trim_ref(remote);
+        toolbox::strings::replace("$image:", "", remote);
+        if (!project_path(remote).empty()) {
+            throw config_parse_error("workspace mount is read-only, can't copy to " + remote, "copy", path);
+        }
+    }
+    for (const auto& cache : caches) {
+        check_dir(cache.path, "caches", cache.name);
+    }
+    for (const auto& job : jobs) {
+        for (const auto& step : job->steps) {
+            check_dir(step->workdir, "jobs", job->name);
+        }
+    }
+    for (const auto& step : matrix.steps) {
+        check_dir(step->workdir, "multijob", "steps");
+    }
+}
+
+std::vector<dockerpack::job_ptr_t> dockerpack::config::select_jobs(const job_filter_t& filter) const {
+    std::vector<job_ptr_t> out;
+    for (const auto& job : jobs) {
+        if (filter(*job)) {
+            out.push_back(job);
+        }
+    }
+    matrix.select(filter, out);
+    return out;
+}
+
+void dockerpack::config::visit_jobs(const job_visitor_t& visitor) const {
+    for (const auto& job : jobs) {
+        visitor(*job);
+    }
+    matrix.visit(visitor);
+}
+
+void dockerpack::config::parse_yaml(bool copy_local) {
+    const YAML::Node config = load_input(cfg_path);
 
 #if !defined(DOCKERPACK_NODEBUG)
     if (config["debug"]) {
@@ -39,14 +183,61 @@ void dockerpack::config::parse(bool copy_local) {
     if (config["commands_verbose"]) {
         commands_verbose = config["commands_verbose"].as<bool>();
     }
+    if (config["log_dir"]) {
+        log_dir = config["log_dir"].as<std::string>();
+        dockerpack::utils::normalize_path(log_dir);
+    }
     if (config["sudo"]) {
         sudo = config["sudo"].as<bool>();
     }
     if (config["workdir"]) {
         workdir = config["workdir"].as<std::string>();
     }
+    if (config["workspace"]) {
+        workspace = config["workspace"].as<std::string>();
+        if (workspace != "copy" && workspace != "mount" && workspace != "overlay") {
+            throw config_parse_error("workspace must be \"copy\", \"mount\" or \"overlay\"", "workspace");
+        }
+        // mount target can't be resolved inside container
+        if (workspace != "copy" && (workdir.empty() || workdir[0] != '/')) {
+            throw config_parse_error("workspace " + workspace + " requires absolute workdir", "workdir");
+        }
+    }
+    if (config["backend"]) {
+        backend = config["backend"].as<std::string>();
+    }
+    if (config["bootstrap_cache"]) {
+        bootstrap_cache = config["bootstrap_cache"].as<bool>();
+    }
+    if (config["sync"]) {
+        sync = config["sync"].as<bool>();
+    }
+    if (config["state_fsync"]) {
+        state_fsync = config["state_fsync"].as<bool>();
+    }
+    if (config["checkpoint_after"]) {
+        checkpoint_after = config["checkpoint_after"].as<size_t>();
+    }
+    if (config["session"]) {
+        session = config["session"].as<bool>();
+        // persistent shell is "docker exec -i", api backend never spawns docker client
+        if (session && backend == "api") {
+            throw config_parse_error("session is not supported by api backend, use cli backend or disable session", "session");
+        }
+    }
+    if (config["watch_events"]) {
+        watch_events = config["watch_events"].as<bool>();
+    }
+    if (config["docker_host"]) {
+        docker_host = config["docker_host"].as<std::string>();
+        if (toolbox::strings::has_substring("unix://", docker_host)) {
+            docker_host = docker_host.substr(7);
+        }
+    }
 
-    if (config["checkout"] && !copy_local) {
+    // mounted project is already in place
+    const bool local_workspace = copy_local || workspace != "copy";
+    if (config["checkout"] && !local_workspace) {
         if (!config["checkout"].IsScalar()) {
             throw config_parse_error("checkout section must be a string", "checkout");
         }
@@ -64,12 +255,35 @@ void dockerpack::config::parse(bool copy_local) {
             copy_paths.push_back(config["copy"].as<std::string>());
         }
     }
-    if (copy_local) {
+    if (copy_local && workspace == "copy") {
         copy_paths.push_back(m_cwd + "/. " + workdir);
     }
+    if (config["copy_exclude"]) {
+        if (config["copy_exclude"].IsSequence()) {
+            copy_exclude = config["copy_exclude"].as<std::vector<std::string>>();
+        } else {
+            copy_exclude.push_back(config["copy_exclude"].as<std::string>());
+        }
+    }
+    if (config["copy_compression"]) {
+        copy_compression = config["copy_compression"].as<std::string>();
+        if (copy_compression != "none" && copy_compression != "zstd") {
+            throw config_parse_error("copy_compression must be \"none\" or \"zstd\"", "copy_compression");
+        }
+    }
+    if (config["copy_threads"]) {
+        copy_threads = config["copy_threads"].as<size_t>();
+    }
+
+    if (config["caches"]) {
+        parse_caches(config["caches"]);
+    }
 
     if (config["include"]) {
-        parse_includes(config["include"]);
+        include_state state;
+        state.chain.push_back(include_path(cfg_path, m_cwd));
+        state.merged.insert(state.chain.back());
+        parse_includes(config["include"], state);
     }
 
     if (!config["commands"]) {
@@ -93,31 +307,41 @@ void dockerpack::config::parse(bool copy_local) {
     }
 }
 
-void dockerpack::config::parse_includes(const YAML::Node& include_list_node) {
+void dockerpack::config::parse_includes(const YAML::Node& include_list_node, include_state& state) {
     std::vector<std::string> include_paths;
     if (include_list_node.IsSequence()) {
         for (const auto& item : include_list_node) {
-            std::string p = item.as<std::string>();
-            dockerpack::utils::normalize_path(p);
-            include_paths.push_back(std::move(p));
+            include_paths.push_back(include_path(item.as<std::string>(), m_cwd));
         }
     } else if (include_list_node.IsScalar()) {
-        std::string p = include_list_node.as<std::string>();
-        dockerpack::utils::normalize_path(p);
-        include_paths.push_back(std::move(p));
+        include_paths.push_back(include_path(include_list_node.as<std::string>(), m_cwd));
     }
 
-    for (const auto& include_path : include_paths) {
+    for (const auto& path : include_paths) {
+        if (std::find(state.chain.begin(), state.chain.end(), path) != state.chain.end()) {
+            std::string chain;
+            for (const auto& item : state.chain) {
+                chain += item + " -> ";
+            }
+            throw std::runtime_error("Include cycle: " + chain + path);
+        }
+        // diamond: file included by several files is merged once, by the first of them
+        if (!state.merged.insert(path).second) {
+            continue;
+        }
+
         YAML::Node config;
         try {
-            config = YAML::LoadFile(include_path);
+            config = load_input(path);
         } catch (const std::exception& e) {
-            throw std::runtime_error("Unable to load include " + include_path + ": " + e.what());
+            throw std::runtime_error("Unable to load include " + path + ": " + e.what());
         }
 
-        // recursive include
+        // includes of included file are merged before it, so it can reference their commands
         if (config["include"]) {
-            parse_includes(config["include"]);
+            state.chain.push_back(path);
+            parse_includes(config["include"], state);
+            state.chain.pop_back();
         }
 
         if (config["commands"]) {
@@ -134,28 +358,15 @@ dockerpack::env_map dockerpack::config::parse_envs(const YAML::Node& node, bool
     for (const auto& env : node) {
         const std::string key = env.first.as<std::string>();
         std::string value = env.second.as<std::string>();
-        if (toolbox::strings::equals_icase(value, "$ENV")) {
-            //todo: print for debug only redacted values, now we just disable debug option for release build
-            if (redacted) {
-                value = "**REDACTED**";
-            } else {
-                const char* v = std::getenv(key.c_str());
-                if (v == nullptr) {
-                    value = "";
-                } else {
-                    value = std::string(v);
-                }
-            }
+        // $ENV is resolved by resolve() after parsing, so cached config doesn't keep environment values
+        if (redacted && toolbox::strings::equals_icase(value, "$ENV")) {
+            value = "**REDACTED**";
         }
         out[key] = std::move(value);
     }
     return out;
 }
 
-static std::string clean_job_name(const std::string& name) {
-    return toolbox::strings::substr_replace_all_ret(std::vector<std::string>{"/", ".", ":"}, "_", name);
-}
-
 void dockerpack::config::parse_multijob(const YAML::Node& multijob_node) {
     if (!multijob_node.IsMap()) {
         throw config_parse_error("multijob node must be a map", "multijob");
@@ -168,13 +379,18 @@ void dockerpack::config::parse_multijob(const YAML::Node& multijob_node) {
         throw config_parse_error("multijob steps must be a list", "multijob", "steps");
     }
 
-    if (!multijob_node["images"]) {
-        throw config_parse_error("multijob must have a images list", "multijob", "images");
+    if (!multijob_node["images"] && !multijob_node["matrix"]) {
+        throw config_parse_error("multijob must have a images list or matrix", "multijob", "images");
     }
-    if (!multijob_node["images"].IsSequence()) {
+    if (multijob_node["images"] && !multijob_node["images"].IsSequence()) {
         throw config_parse_error("multijob images must be a list", "multijob", "images");
     }
 
+    if (multijob_node["matrix"]) {
+        parse_matrix(multijob_node);
+        return;
+    }
+
     std::vector<job_ptr_t> local_jobs;
     local_jobs.reserve(multijob_node["images"].size());
 
@@ -189,9 +405,8 @@ void dockerpack::config::parse_multijob(const YAML::Node& multijob_node) {
         if (image.IsScalar()) {
             job_ptr_t job = std::make_shared<dockerpack::job>();
             job->image = image.as<std::string>();
-            job->name = clean_job_name(job->image);
-            job->envs.insert(global_envs.cbegin(), global_envs.cend());
-            job->envs.insert(local_envs.begin(), local_envs.end());
+            job->name = dockerpack::utils::clean_name(job->image);
+            job->envs = local_envs;
 
             local_jobs.push_back(std::move(job));
         } else if (image.IsMap()) {
@@ -199,7 +414,7 @@ void dockerpack::config::parse_multijob(const YAML::Node& multijob_node) {
             if (image["image"]) {
                 job_ptr_t job = std::make_shared<dockerpack::job>();
                 job->image = image["image"].as<std::string>();
-                job->name = clean_job_name(job->image);
+                job->name = dockerpack::utils::clean_name(job->image);
 
                 if (image["steps"] && image["steps"].IsSequence()) {
                     auto job_steps_before = parse_steps(image["steps"]);
@@ -211,22 +426,20 @@ void dockerpack::config::parse_multijob(const YAML::Node& multijob_node) {
                 for (const auto& item : image["images"]) {
                     job_ptr_t job = std::make_shared<dockerpack::job>();
                     job->image = item.as<std::string>();
-                    job->name = clean_job_name(job->image);
+                    job->name = dockerpack::utils::clean_name(job->image);
                     jobs_tmp.push_back(std::move(job));
                 }
             } else {
                 throw config_parse_error("multijob image does not have a docker image or image list name with tag", "multijob", "images[" + std::to_string(i) + "]");
             }
 
-            if (image["env"]) {
-                const auto image_envs = parse_envs(image["env"]);
-                for (auto& job : jobs_tmp) {
-                    // add global envs
-                    job->envs.insert(global_envs.cbegin(), global_envs.cend());
-                    // add parsed local multijob-root envs
-                    job->envs.insert(local_envs.begin(), local_envs.end());
-                    // add image-local envs; if something repeats, priority to local env
-                    job->envs.insert(image_envs.begin(), image_envs.end());
+            // global envs are not copied, they are merged with step envs on exec
+            const auto image_envs = image["env"] ? parse_envs(image["env"]) : env_map();
+            for (auto& job : jobs_tmp) {
+                job->envs = local_envs;
+                // if something repeats, priority to image-local env
+                for (const auto& kv : image_envs) {
+                    job->envs[kv.first] = kv.second;
                 }
             }
 
@@ -238,14 +451,33 @@ void dockerpack::config::parse_multijob(const YAML::Node& multijob_node) {
         i++;
     }
 
-    std::vector<step_ptr_t> local_steps;
-    i = 0;
-    for (const auto& step : multijob_node["steps"]) {
+    const std::vector<step_ptr_t> local_steps = parse_multijob_steps(multijob_node["steps"]);
+    for (auto& job : local_jobs) {
+        job->steps = local_steps;
+    }
+
+    jobs = std::move(local_jobs);
+}
+
+std::vector<dockerpack::step_ptr_t> dockerpack::config::parse_multijob_steps(const YAML::Node& steps_node) {
+    std::vector<step_ptr_t> out;
+    if (!checkout_command.empty()) {
+        out.push_back(
+            create_step(
+                arena,
+                checkout_command,
+                "checkout",
+                false,
+                workdir));
+    }
+
+    size_t i = 0;
+    for (const auto& step : steps_node) {
         if (step.IsScalar()) {
             std::string step_name = step.as<std::string>();
             if (steps.count(step_name)) {
-                local_steps.insert(
-                    local_steps.end(),
+                out.insert(
+                    out.end(),
                     steps[step_name].begin(),
                     steps[step_name].begin() + steps[step_name].size());
             } else {
@@ -255,23 +487,157 @@ void dockerpack::config::parse_multijob(const YAML::Node& multijob_node) {
 
         i++;
     }
+    return out;
+}
 
-    for (auto& job : local_jobs) {
-        if (!checkout_command.empty()) {
-            job->steps.push_back(
-                create_step(
-                    checkout_command,
-                    "checkout",
-                    false,
-                    workdir));
+void dockerpack::config::parse_matrix(const YAML::Node& multijob_node) {
+    const YAML::Node matrix_node = multijob_node["matrix"];
+    if (!matrix_node.IsMap()) {
+        throw config_parse_error("multijob matrix must be a map", "multijob", "matrix");
+    }
+
+    job_matrix::axis image_axis;
+    image_axis.name = job_matrix::IMAGE_AXIS;
+    if (multijob_node["images"]) {
+        for (const auto& image : multijob_node["images"]) {
+            if (!image.IsScalar()) {
+                throw config_parse_error("multijob images must be plain image names if matrix is used", "multijob", "images");
+            }
+            image_axis.values.push_back(image.as<std::string>());
         }
-        job->steps.insert(
-            job->steps.end(),
-            local_steps.begin(),
-            local_steps.end());
     }
 
-    jobs = std::move(local_jobs);
+    std::vector<job_matrix::axis> axes;
+    for (const auto& axis_node : matrix_node) {
+        const std::string name = axis_node.first.as<std::string>();
+        if (name == "include" || name == "exclude") {
+            continue;
+        }
+        if (!axis_node.second.IsSequence()) {
+            throw config_parse_error("matrix axis must be a list of values", "multijob.matrix", name);
+        }
+        job_matrix::axis axis;
+        axis.name = name;
+        for (const auto& value : axis_node.second) {
+            axis.values.push_back(value.as<std::string>());
+        }
+
+        if (name != job_matrix::IMAGE_AXIS) {
+            axes.push_back(std::move(axis));
+        } else if (!image_axis.values.empty()) {
+            throw config_parse_error("images are set both in multijob images and matrix", "multijob.matrix", name);
+        } else {
+            image_axis = std::move(axis);
+        }
+    }
+    if (image_axis.values.empty() && !axes.empty()) {
+        throw config_parse_error("matrix does not have images: set multijob images or matrix image axis", "multijob", "matrix");
+    }
+
+    matrix = job_matrix();
+    if (!image_axis.values.empty()) {
+        matrix.axes.push_back(std::move(image_axis));
+    }
+    std::move(axes.begin(), axes.end(), std::back_inserter(matrix.axes));
+
+    const auto has_axis = [this](const std::string& name) {
+        return std::any_of(matrix.axes.begin(), matrix.axes.end(), [&name](const job_matrix::axis& axis) {
+            return axis.name == name;
+        });
+    };
+
+    size_t i = 0;
+    for (const auto& rule_node : matrix_node["exclude"]) {
+        const std::string print_name = "exclude[" + std::to_string(i++) + "]";
+        if (!rule_node.IsMap()) {
+            throw config_parse_error("matrix exclude rule must be a map of axis values", "multijob.matrix", print_name);
+        }
+        job_matrix::cell_t rule;
+        for (const auto& kv : rule_node) {
+            const std::string name = kv.first.as<std::string>();
+            if (!has_axis(name)) {
+                throw config_parse_error("matrix exclude rule has unknown axis " + name, "multijob.matrix", print_name);
+            }
+            rule.emplace_back(name, kv.second.as<std::string>());
+        }
+        matrix.exclude.push_back(std::move(rule));
+    }
+
+    i = 0;
+    for (const auto& cell_node : matrix_node["include"]) {
+        const std::string print_name = "include[" + std::to_string(i++) + "]";
+        if (!cell_node.IsMap() || !cell_node[job_matrix::IMAGE_AXIS]) {
+            throw config_parse_error("matrix include must be a map of axis values with image", "multijob.matrix", print_name);
+        }
+        // the same order of axes as in generated cells, so job names are built the same way
+        job_matrix::cell_t cell;
+        for (const auto& axis : matrix.axes) {
+            if (cell_node[axis.name]) {
+                cell.emplace_back(axis.name, cell_node[axis.name].as<std::string>());
+            }
+        }
+        if (!has_axis(job_matrix::IMAGE_AXIS)) {
+            cell.emplace(cell.begin(), job_matrix::IMAGE_AXIS, cell_node[job_matrix::IMAGE_AXIS].as<std::string>());
+        }
+        for (const auto& kv : cell_node) {
+            const std::string name = kv.first.as<std::string>();
+            if (!has_axis(name) && name != job_matrix::IMAGE_AXIS) {
+                cell.emplace_back(name, kv.second.as<std::string>());
+            }
+        }
+        // included cell which is generated anyway
+        if (matrix.contains(cell)) {
+            continue;
+        }
+        matrix.include.push_back(std::move(cell));
+    }
+
+    matrix.envs.clear();
+    if (multijob_node["env"]) {
+        matrix.envs = parse_envs(multijob_node["env"]);
+    }
+    matrix.steps = parse_multijob_steps(multijob_node["steps"]);
+}
+
+void dockerpack::config::parse_caches(const YAML::Node& caches_node) {
+    if (!caches_node.IsMap()) {
+        throw config_parse_error("caches must be a map", "caches");
+    }
+
+    for (const auto& cache_node : caches_node) {
+        cache_volume cache;
+        cache.name = cache_node.first.as<std::string>();
+        if (cache_node.second.IsScalar()) {
+            // short form: "name: /path"
+            cache.path = cache_node.second.as<std::string>();
+        } else if (cache_node.second.IsMap()) {
+            if (!cache_node.second["path"]) {
+                throw config_parse_error("cache does not have a path", "caches", cache.name);
+            }
+            cache.path = cache_node.second["path"].as<std::string>();
+            if (cache_node.second["key"]) {
+                cache.key = cache_node.second["key"].as<std::string>();
+            }
+            if (cache_node.second["host"]) {
+                cache.host_path = cache_node.second["host"].as<std::string>();
+                dockerpack::utils::normalize_path(cache.host_path);
+            }
+            if (cache_node.second["max_size"]) {
+                try {
+                    cache.max_size = dockerpack::utils::parse_size(cache_node.second["max_size"].as<std::string>());
+                } catch (const std::runtime_error& e) {
+                    throw config_parse_error(e.what(), "caches", cache.name);
+                }
+            }
+        } else {
+            throw config_parse_error("cache must be a path or a map", "caches", cache.name);
+        }
+
+        if (cache.path.empty() || cache.path[0] != '/') {
+            throw config_parse_error("cache path must be absolute", "caches", cache.name);
+        }
+        caches.push_back(std::move(cache));
+    }
 }
 
 void dockerpack::config::parse_build_images(const YAML::Node& build_images_node) {
@@ -297,9 +663,7 @@ void dockerpack::config::parse_build_images(const YAML::Node& build_images_node)
             throw config_parse_error("Image does not have a tag name", "build_images", image->name);
         }
         if (image_node.second["env"]) {
-            auto envs = parse_envs(image_node.second["env"]);
-            image->envs.insert(global_envs.cbegin(), global_envs.cend());
-            image->envs.insert(envs.begin(), envs.end());
+            image->envs = parse_envs(image_node.second["env"]);
         }
 
         image->image = image_node.second["image"].as<std::string>();
@@ -316,9 +680,7 @@ void dockerpack::config::parse_build_images(const YAML::Node& build_images_node)
                         steps[step_name].begin() + steps[step_name].size());
                 } else {
                     // user added undefined command, add it too to local job scope
-                    step_ptr_t step = std::make_shared<dockerpack::step>();
-                    step->command = step_name;
-                    image->steps.push_back(std::move(step));
+                    image->steps.push_back(create_step(arena, step_name));
                 }
             }
         }
@@ -334,6 +696,7 @@ void dockerpack::config::parse_jobs(const YAML::Node& jobs_node) {
         if (!checkout_command.empty()) {
             job->steps.push_back(
                 create_step(
+                    arena,
                     checkout_command,
                     "checkout",
                     false,
@@ -350,10 +713,8 @@ void dockerpack::config::parse_jobs(const YAML::Node& jobs_node) {
             throw config_parse_error("Job does not have a steps list.", "jobs", job->name);
         }
 
-        job->envs.insert(global_envs.cbegin(), global_envs.cend());
         if (job_node.second["env"] && job_node.second["env"].IsMap()) {
-            std::unordered_map<std::string, std::string> envs = parse_envs(job_node.second["env"]);
-            job->envs.insert(envs.begin(), envs.end());
+            job->envs = parse_envs(job_node.second["env"]);
         }
 
         job->image = job_node.second["image"].as<std::string>();
@@ -369,7 +730,7 @@ void dockerpack::config::parse_jobs(const YAML::Node& jobs_node) {
                         steps[step_name].begin() + steps[step_name].size());
                 } else {
                     // user added undefined command, add it too to local job scope
-                    job->steps.push_back(create_step(step_name));
+                    job->steps.push_back(create_step(arena, step_name));
                 }
             }
         }
@@ -378,61 +739,55 @@ void dockerpack::config::parse_jobs(const YAML::Node& jobs_node) {
     }
 }
 
-std::vector<dockerpack::step_ptr_t> dockerpack::config::parse_steps(const YAML::Node& steps_node) const {
+std::vector<dockerpack::step_ptr_t> dockerpack::config::parse_steps(const YAML::Node& steps_node) {
     std::vector<step_ptr_t> out;
     out.reserve(steps_node.size());
+    // step which command is a name of another command is replaced with it's steps
+    const auto add_step = [this, &out](dockerpack::step&& step) {
+        const auto ref = steps.find(step.command);
+        if (ref != steps.end()) {
+            out.insert(out.end(), ref->second.begin(), ref->second.end());
+        } else {
+            out.push_back(arena.intern(std::move(step)));
+        }
+    };
+
     for (const auto& config_step : steps_node) {
         if (config_step.IsMap()) {
             if (config_step["run"]) {
                 if (config_step["run"].IsScalar()) {
-                    step_ptr_t step = create_step(config_step["run"].as<std::string>());
-                    if (steps.count(step->command)) {
-                        for (auto& s : steps.at(step->command)) {
-                            out.push_back(s->shared_from_this());
-                        }
-                    } else {
-                        out.push_back(std::move(step));
-                    }
+                    dockerpack::step step;
+                    step.command = config_step["run"].as<std::string>();
+                    add_step(std::move(step));
 
                 } else if (config_step["run"].IsMap() && config_step["run"]["command"]) {
 
-                    auto step = std::make_shared<dockerpack::step>();
-                    step->command = config_step["run"]["command"].as<std::string>();
+                    dockerpack::step step;
+                    step.command = config_step["run"]["command"].as<std::string>();
                     if (config_step["run"]["name"]) {
-                        step->name = config_step["run"]["name"].as<std::string>();
+                        step.name = config_step["run"]["name"].as<std::string>();
                     }
                     if (config_step["run"]["workdir"]) {
-                        step->workdir = config_step["run"]["workdir"].as<std::string>();
+                        step.workdir = config_step["run"]["workdir"].as<std::string>();
                     }
-                    step->skip_on_error = config_step["run"]["skip_on_error"] != nullptr && config_step["run"]["skip_on_error"].as<bool>();
-                    step->envs.insert(global_envs.cbegin(), global_envs.cend());
+                    step.skip_on_error = config_step["run"]["skip_on_error"] != nullptr && config_step["run"]["skip_on_error"].as<bool>();
+                    // global envs are not copied here, docker::exec_envs() puts them under step envs
                     if (config_step["run"]["env"]) {
-                        auto envs = parse_envs(config_step["run"]["env"]);
-                        step->envs.insert(envs.begin(), envs.end());
+                        step.envs = parse_envs(config_step["run"]["env"]);
                     }
                     if (config_step["run"]["stateless"]) {
-                        step->stateless = config_step["run"]["stateless"].as<bool>();
+                        step.stateless = config_step["run"]["stateless"].as<bool>();
                     }
-
-                    // check command step is a reference to another command
-                    if (steps.count(step->command)) {
-                        for (auto& s : steps.at(step->command)) {
-                            out.push_back(s->shared_from_this());
-                        }
-                    } else {
-                        out.push_back(std::move(step));
+                    if (config_step["run"]["checkpoint"]) {
+                        step.checkpoint = config_step["run"]["checkpoint"].as<bool>();
                     }
+                    add_step(std::move(step));
                 }
             }
         } else if (config_step.IsScalar()) {
-            step_ptr_t step = create_step(config_step.as<std::string>());
-            if (steps.count(step->command)) {
-                for (auto& s : steps.at(step->command)) {
-                    out.push_back(s->shared_from_this());
-                }
-            } else {
-                out.push_back(std::move(step));
-            }
+            dockerpack::step step;
+            step.command = config_step.as<std::string>();
+            add_step(std::move(step));
         }
     }
     return out;
@@ -468,22 +823,17 @@ void dockerpack::config::parse_commands(const YAML::Node& commands) {
     }
 }
 void dockerpack::config::insert_step(const std::string& print_name, std::string&& command, std::string&& name, bool skip_on_error) {
-    step_ptr_t step = std::make_shared<dockerpack::step>();
-    step->command = std::move(command);
-    step->name = std::move(name);
-    step->skip_on_error = skip_on_error;
-
     // nested steps: any step can include another step simply by it's name
-    if (steps.count(step->command)) {
-        if (toolbox::strings::equals_icase(step->command, print_name)) {
+    if (steps.count(command)) {
+        if (toolbox::strings::equals_icase(command, print_name)) {
             throw config_parse_error("Command can't links to itself", "commands", print_name);
         }
         steps[print_name].insert(
             steps[print_name].end(),
-            steps[step->command].begin(),
-            steps[step->command].begin() + steps[step->command].size());
+            steps[command].begin(),
+            steps[command].begin() + steps[command].size());
     } else {
         // insert
-        steps[print_name].push_back(std::move(step));
+        steps[print_name].push_back(create_step(arena, std::move(command), std::move(name), skip_on_error));
     }
 }
@@ -11,11 +11,13 @@
 
 #include "data.h"
 #include "execmd.h"
+#include "matrix.h"
 
 #include <cstdlib>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <yaml-cpp/yaml.h>
 
@@ -41,6 +43,25 @@ public:
     }
 };
 
+/// \brief Persistent directory shared by containers of all jobs and runs
+struct cache_volume {
+    std::string name;
+    // absolute path inside container
+    std::string path;
+    // volume name suffix template: {image}, {job} and {name} are replaced. Jobs with the same key share the cache
+    std::string key = "{image}";
+    // host directory template (bind mount), docker named volume is used if empty
+    std::string host_path;
+    // bytes, least recently used files are removed after job if cache is larger, 0 - unlimited
+    uint64_t max_size = 0;
+};
+
+/// \brief File config has been loaded from and digest of it's content
+struct config_input {
+    std::string path;
+    digest_t digest;
+};
+
 class config : public std::enable_shared_from_this<dockerpack::config> {
 public:
     std::string cfg_path;
@@ -49,25 +70,84 @@ public:
     bool sudo = true;
     bool commands_verbose = true;
     std::string docker_repository;
+    // docker backend: "cli" or "api"
+    std::string backend;
+    // docker engine unix socket path for "api" backend
+    std::string docker_host;
+    // follow docker events to notice containers removed outside of dockerpack
+    bool watch_events = false;
+    // execute steps in one persistent shell per job instead of "docker exec" per step
+    bool session = false;
+    // cache container facts (env, os, cpu count) by image id
+    bool bootstrap_cache = true;
+    // copy only changed files of directories
+    bool sync = false;
+    // flush state journal to disk after every step
+    bool state_fsync = true;
+    // commit job container to snapshot image after every step running longer than this (seconds), 0 - disabled
+    size_t checkpoint_after = 0;
+    // directory of step output logs (relative to current directory), empty - logs are disabled
+    std::string log_dir = ".dockerpack/logs";
     std::string workdir;
+    // how project gets into job containers: "copy" - checkout and copy paths, "mount" - read-only bind mount
+    // of project directory at workdir (steps can't write to it), "overlay" - the same with private writable layer per job
+    std::string workspace = "copy";
     std::vector<std::string> copy_paths;
+    std::vector<cache_volume> caches;
+    // gitignore-like patterns excluded from copied directories in addition to .dockerpackignore
+    std::vector<std::string> copy_exclude;
+    // compression of copied directories archive: "none" or "zstd"
+    std::string copy_compression = "none";
+    // threads reading and compressing copied files, 0 - number of CPU cores
+    size_t copy_threads = 0;
+    // owns steps of all commands, jobs and images
+    step_arena arena;
+    // command name -> expanded steps
     std::unordered_map<std::string, std::vector<step_ptr_t>> steps;
     std::vector<job_ptr_t> jobs;
+    // multijob matrix, it's jobs are not in "jobs" and created by select_jobs()
+    job_matrix matrix;
     std::vector<imb_ptr_t> build_images;
     std::string m_cwd;
     env_map global_envs;
+    // main config file and all includes in order of loading
+    std::vector<config_input> inputs;
+    // load expanded config from cache if inputs are not changed, and save it after parsing
+    bool use_cache = true;
 
     config(std::string cwd, std::string cfg_path);
 
     void parse(bool copy_local = false);
+    /// \brief Jobs accepted by filter, including matrix ones
+    std::vector<job_ptr_t> select_jobs(const job_filter_t& filter) const;
+    /// \brief Pass every job to visitor, matrix jobs are not created
+    void visit_jobs(const job_visitor_t& visitor) const;
 
 private:
-    void parse_includes(const YAML::Node& include_list_node);
+    struct include_state {
+        // files being merged, from main config to current include
+        std::vector<std::string> chain;
+        // normalized paths of files already loaded
+        std::unordered_set<std::string> merged;
+    };
+
+    void parse_yaml(bool copy_local);
+    YAML::Node load_input(const std::string& path);
+    /// \brief Resolve $ENV values and calculate step digests, done after parsing and after loading from cache
+    void resolve();
+    /// \brief Mounted project is read-only: reject copy paths into workdir, and step workdirs and caches inside it
+    /// which are not in project directory, as they can't be created. Checked on every run, project could be changed
+    void validate_workspace() const;
+    void parse_includes(const YAML::Node& include_list_node, include_state& state);
+    void parse_caches(const YAML::Node& caches_node);
     void parse_build_images(const YAML::Node& build_images_node);
     void parse_jobs(const YAML::Node& jobs_node);
     void parse_multijob(const YAML::Node& multijob_node);
+    void parse_matrix(const YAML::Node& multijob_node);
+    /// \brief Checkout and steps of multijob commands
+    std::vector<step_ptr_t> parse_multijob_steps(const YAML::Node& steps_node);
     void parse_commands(const YAML::Node& commands);
-    std::vector<step_ptr_t> parse_steps(const YAML::Node& steps_node) const;
+    std::vector<step_ptr_t> parse_steps(const YAML::Node& steps_node);
     void insert_step(const std::string& print_name, std::string&& command, std::string&& name, bool skip_on_error = false);
     env_map parse_envs(const YAML::Node& node, bool redacted = false) const;
 };
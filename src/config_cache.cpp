@@ -0,0 +1,326 @@
+/*!
+ * dockerpack.
+ * config_cache.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "config_cache.h"
+
+#include "config.h"
+#include "utils.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <unordered_map>
+
+// increase on any change of stored fields
+static const int CACHE_FORMAT = 4;
+
+#if defined(DOCKERPACK_NODEBUG)
+static const bool CACHE_NODEBUG = true;
+#else
+static const bool CACHE_NODEBUG = false;
+#endif
+
+/// \brief Environment values parser depends on: "~" expansion and default docker host
+static nlohmann::json parser_environment() {
+    nlohmann::json out = nlohmann::json::object();
+    for (const char* name : {"HOME", "DOCKER_HOST"}) {
+        const char* value = std::getenv(name);
+        out[name] = value == nullptr ? std::string() : std::string(value);
+    }
+    return out;
+}
+
+static bool read_file(const std::string& path, std::string& out) {
+    std::ifstream is(path, std::ios::in | std::ios::binary);
+    if (!is.is_open()) {
+        return false;
+    }
+    std::stringstream ss;
+    ss << is.rdbuf();
+    out = ss.str();
+    return true;
+}
+
+dockerpack::config_cache::config_cache(const std::string& cfg_path, const std::string& cwd, bool copy_local)
+    : m_cfg_path(cfg_path),
+      m_cwd(cwd),
+      m_copy_local(copy_local) {
+    boost::system::error_code ec;
+    std::string abs_path = boost::filesystem::absolute(cfg_path, ec).string();
+    if (ec) {
+        abs_path = cfg_path;
+    }
+    const std::string key = abs_path + '\0' + cwd + '\0' + (copy_local ? "1" : "0");
+    m_path = dockerpack::utils::cache_dir("config") + "/" + to_hex(sha256(key)) + ".cbor";
+}
+
+static nlohmann::json step_to_json(const dockerpack::step& step) {
+    return {
+        {"name", step.name},
+        {"command", step.command},
+        {"skip_on_error", step.skip_on_error},
+        {"stateless", step.stateless},
+        {"checkpoint", step.checkpoint},
+        {"workdir", step.workdir},
+        {"envs", step.envs},
+    };
+}
+
+static dockerpack::step step_from_json(const nlohmann::json& j) {
+    dockerpack::step step;
+    step.name = j.at("name").get<std::string>();
+    step.command = j.at("command").get<std::string>();
+    step.skip_on_error = j.at("skip_on_error").get<bool>();
+    step.stateless = j.at("stateless").get<bool>();
+    step.checkpoint = j.at("checkpoint").get<bool>();
+    step.workdir = j.at("workdir").get<std::string>();
+    step.envs = j.at("envs").get<dockerpack::env_map>();
+    return step;
+}
+
+void dockerpack::config_cache::save(const dockerpack::config& cfg) const {
+    // steps are shared by commands and jobs: every arena step is stored once and referenced by index
+    nlohmann::json steps = nlohmann::json::array();
+    std::unordered_map<const step*, size_t> step_index;
+    const auto step_refs = [&steps, &step_index](const std::vector<step_ptr_t>& items) {
+        nlohmann::json refs = nlohmann::json::array();
+        for (const auto& item : items) {
+            auto it = step_index.find(item);
+            if (it == step_index.end()) {
+                it = step_index.emplace(item, steps.size()).first;
+                steps.push_back(step_to_json(*item));
+            }
+            refs.push_back(it->second);
+        }
+        return refs;
+    };
+
+    nlohmann::json commands = nlohmann::json::object();
+    for (const auto& kv : cfg.steps) {
+        commands[kv.first] = step_refs(kv.second);
+    }
+
+    nlohmann::json jobs = nlohmann::json::array();
+    for (const auto& job : cfg.jobs) {
+        jobs.push_back({
+            {"name", job->name},
+            {"image", job->image},
+            {"envs", job->envs},
+            {"steps", step_refs(job->steps)},
+        });
+    }
+
+    nlohmann::json axes = nlohmann::json::array();
+    for (const auto& axis : cfg.matrix.axes) {
+        axes.push_back({{"name", axis.name}, {"values", axis.values}});
+    }
+    nlohmann::json matrix = {
+        {"axes", std::move(axes)},
+        {"exclude", cfg.matrix.exclude},
+        {"include", cfg.matrix.include},
+        {"envs", cfg.matrix.envs},
+        {"steps", step_refs(cfg.matrix.steps)},
+    };
+
+    nlohmann::json images = nlohmann::json::array();
+    for (const auto& image : cfg.build_images) {
+        images.push_back({
+            {"name", image->name},
+            {"image", image->image},
+            {"repo", image->repo},
+            {"tag", image->tag},
+            {"envs", image->envs},
+            {"steps", step_refs(image->steps)},
+        });
+    }
+
+    nlohmann::json caches = nlohmann::json::array();
+    for (const auto& cache : cfg.caches) {
+        caches.push_back({
+            {"name", cache.name},
+            {"path", cache.path},
+            {"key", cache.key},
+            {"host_path", cache.host_path},
+            {"max_size", cache.max_size},
+        });
+    }
+
+    nlohmann::json inputs = nlohmann::json::array();
+    for (const auto& input : cfg.inputs) {
+        inputs.push_back({{"path", input.path}, {"digest", to_hex(input.digest)}});
+    }
+
+    nlohmann::json j;
+    j["format"] = CACHE_FORMAT;
+    j["version"] = DOCKERPACK_VERSION;
+    j["nodebug"] = CACHE_NODEBUG;
+    j["cfg_path"] = m_cfg_path;
+    j["cwd"] = m_cwd;
+    j["copy_local"] = m_copy_local;
+    j["environment"] = parser_environment();
+    j["inputs"] = std::move(inputs);
+
+    nlohmann::json c;
+    c["checkout_command"] = cfg.checkout_command;
+    c["debug"] = cfg.debug;
+    c["sudo"] = cfg.sudo;
+    c["commands_verbose"] = cfg.commands_verbose;
+    c["docker_repository"] = cfg.docker_repository;
+    c["backend"] = cfg.backend;
+    c["docker_host"] = cfg.docker_host;
+    c["watch_events"] = cfg.watch_events;
+    c["session"] = cfg.session;
+    c["bootstrap_cache"] = cfg.bootstrap_cache;
+    c["sync"] = cfg.sync;
+    c["state_fsync"] = cfg.state_fsync;
+    c["checkpoint_after"] = cfg.checkpoint_after;
+    c["log_dir"] = cfg.log_dir;
+    c["workdir"] = cfg.workdir;
+    c["workspace"] = cfg.workspace;
+    c["copy_paths"] = cfg.copy_paths;
+    c["copy_exclude"] = cfg.copy_exclude;
+    c["copy_compression"] = cfg.copy_compression;
+    c["copy_threads"] = cfg.copy_threads;
+    c["global_envs"] = cfg.global_envs;
+    c["caches"] = std::move(caches);
+    c["steps"] = std::move(steps);
+    c["commands"] = std::move(commands);
+    c["jobs"] = std::move(jobs);
+    c["matrix"] = std::move(matrix);
+    c["build_images"] = std::move(images);
+    j["config"] = std::move(c);
+
+    const std::vector<uint8_t> data = nlohmann::json::to_cbor(j);
+    dockerpack::utils::write_file_atomic(m_path, std::string(data.begin(), data.end()));
+}
+
+bool dockerpack::config_cache::load(dockerpack::config& cfg) const {
+    std::string data;
+    if (!read_file(m_path, data)) {
+        return false;
+    }
+    const nlohmann::json j = nlohmann::json::from_cbor(data, true, false);
+    if (j.is_discarded() || !j.is_object()) {
+        return false;
+    }
+
+    try {
+        if (j.at("format").get<int>() != CACHE_FORMAT
+            || j.at("version").get<std::string>() != DOCKERPACK_VERSION
+            || j.at("nodebug").get<bool>() != CACHE_NODEBUG
+            || j.at("cfg_path").get<std::string>() != m_cfg_path
+            || j.at("cwd").get<std::string>() != m_cwd
+            || j.at("copy_local").get<bool>() != m_copy_local
+            || j.at("environment") != parser_environment()) {
+            return false;
+        }
+
+        std::vector<config_input> inputs;
+        for (const auto& item : j.at("inputs")) {
+            config_input input;
+            input.path = item.at("path").get<std::string>();
+            std::string content;
+            if (!from_hex(item.at("digest").get<std::string>(), input.digest) || !read_file(input.path, content)) {
+                return false;
+            }
+            if (sha256(content) != input.digest) {
+                return false;
+            }
+            inputs.push_back(std::move(input));
+        }
+
+        const nlohmann::json& c = j.at("config");
+        dockerpack::config loaded(cfg.m_cwd, cfg.cfg_path);
+        loaded.inputs = std::move(inputs);
+        loaded.use_cache = cfg.use_cache;
+        loaded.checkout_command = c.at("checkout_command").get<std::string>();
+        loaded.debug = c.at("debug").get<bool>();
+        loaded.sudo = c.at("sudo").get<bool>();
+        loaded.commands_verbose = c.at("commands_verbose").get<bool>();
+        loaded.docker_repository = c.at("docker_repository").get<std::string>();
+        loaded.backend = c.at("backend").get<std::string>();
+        loaded.docker_host = c.at("docker_host").get<std::string>();
+        loaded.watch_events = c.at("watch_events").get<bool>();
+        loaded.session = c.at("session").get<bool>();
+        loaded.bootstrap_cache = c.at("bootstrap_cache").get<bool>();
+        loaded.sync = c.at("sync").get<bool>();
+        loaded.state_fsync = c.at("state_fsync").get<bool>();
+        loaded.checkpoint_after = c.at("checkpoint_after").get<size_t>();
+        loaded.log_dir = c.at("log_dir").get<std::string>();
+        loaded.workdir = c.at("workdir").get<std::string>();
+        loaded.workspace = c.at("workspace").get<std::string>();
+        loaded.copy_paths = c.at("copy_paths").get<std::vector<std::string>>();
+        loaded.copy_exclude = c.at("copy_exclude").get<std::vector<std::string>>();
+        loaded.copy_compression = c.at("copy_compression").get<std::string>();
+        loaded.copy_threads = c.at("copy_threads").get<size_t>();
+        loaded.global_envs = c.at("global_envs").get<env_map>();
+
+        for (const auto& item : c.at("caches")) {
+            cache_volume cache;
+            cache.name = item.at("name").get<std::string>();
+            cache.path = item.at("path").get<std::string>();
+            cache.key = item.at("key").get<std::string>();
+            cache.host_path = item.at("host_path").get<std::string>();
+            cache.max_size = item.at("max_size").get<uint64_t>();
+            loaded.caches.push_back(std::move(cache));
+        }
+
+        std::vector<step_ptr_t> steps;
+        for (const auto& item : c.at("steps")) {
+            steps.push_back(loaded.arena.intern(step_from_json(item)));
+        }
+        const auto step_refs = [&steps](const nlohmann::json& refs) {
+            std::vector<step_ptr_t> out;
+            out.reserve(refs.size());
+            for (const auto& ref : refs) {
+                out.push_back(steps.at(ref.get<size_t>()));
+            }
+            return out;
+        };
+
+        for (const auto& kv : c.at("commands").items()) {
+            loaded.steps[kv.key()] = step_refs(kv.value());
+        }
+        for (const auto& item : c.at("jobs")) {
+            job_ptr_t job = std::make_shared<dockerpack::job>();
+            job->name = item.at("name").get<std::string>();
+            job->image = item.at("image").get<std::string>();
+            job->envs = item.at("envs").get<env_map>();
+            job->steps = step_refs(item.at("steps"));
+            loaded.jobs.push_back(std::move(job));
+        }
+        const nlohmann::json& matrix = c.at("matrix");
+        for (const auto& item : matrix.at("axes")) {
+            job_matrix::axis axis;
+            axis.name = item.at("name").get<std::string>();
+            axis.values = item.at("values").get<std::vector<std::string>>();
+            loaded.matrix.axes.push_back(std::move(axis));
+        }
+        loaded.matrix.exclude = matrix.at("exclude").get<std::vector<job_matrix::cell_t>>();
+        loaded.matrix.include = matrix.at("include").get<std::vector<job_matrix::cell_t>>();
+        loaded.matrix.envs = matrix.at("envs").get<env_map>();
+        loaded.matrix.steps = step_refs(matrix.at("steps"));
+
+        for (const auto& item : c.at("build_images")) {
+            imb_ptr_t image = std::make_shared<dockerpack::image_to_build>();
+            image->name = item.at("name").get<std::string>();
+            image->image = item.at("image").get<std::string>();
+            image->repo = item.at("repo").get<std::string>();
+            image->tag = item.at("tag").get<std::string>();
+            image->envs = item.at("envs").get<env_map>();
+            image->steps = step_refs(item.at("steps"));
+            loaded.build_images.push_back(std::move(image));
+        }
+
+        cfg = std::move(loaded);
+    } catch (const std::exception&) {
+        // written by other version or damaged
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+/*!
+ * dockerpack.
+ * config_cache.h
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#ifndef DOCKERPACK_CONFIG_CACHE_H
+#define DOCKERPACK_CONFIG_CACHE_H
+
+#include <string>
+
+namespace dockerpack {
+
+class config;
+
+/// \brief Fully expanded config (jobs, steps, envs, build_images) stored in CBOR,
+/// so next run with unchanged config and includes doesn't parse YAML at all.
+/// Cache is valid while content of every input file, dockerpack version, arguments which change parsing
+/// and environment used by parser are the same. $ENV values are stored unresolved.
+class config_cache {
+public:
+    config_cache(const std::string& cfg_path, const std::string& cwd, bool copy_local);
+
+    /// \brief Replace config with cached one
+    /// \return false if cache does not exist or outdated, config is not changed then
+    bool load(config& cfg) const;
+    /// \brief Store parsed config with digests of it's inputs. $ENV values must not be resolved yet
+    void save(const config& cfg) const;
+
+private:
+    std::string m_path;
+    std::string m_cfg_path;
+    std::string m_cwd;
+    bool m_copy_local;
+};
+
+} // namespace dockerpack
+
+#endif //DOCKERPACK_CONFIG_CACHE_H
@@ -9,14 +9,115 @@
 
 #include "data.h"
 
+#include <map>
 #include <sodium/crypto_hash_sha256.h>
-#include <toolbox/data/bytes_data.h>
 #include <toolbox/strings.hpp>
+
+dockerpack::digest_t dockerpack::sha256(const std::string& data) {
+    dockerpack::digest_t out;
+    crypto_hash_sha256(out.data(), reinterpret_cast<const unsigned char*>(data.data()), data.size());
+    return out;
+}
+
+std::string dockerpack::to_hex(const digest_t& digest) {
+    static const char hex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(digest.size() * 2);
+    for (uint8_t c : digest) {
+        out.push_back(hex[c >> 4]);
+        out.push_back(hex[c & 0x0F]);
+    }
+    return out;
+}
+
+bool dockerpack::from_hex(const std::string& value, digest_t& digest) {
+    if (value.size() != digest.size() * 2) {
+        return false;
+    }
+    const auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    };
+    for (size_t i = 0; i < digest.size(); i++) {
+        const int hi = nibble(value[i * 2]);
+        const int lo = nibble(value[i * 2 + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        digest[i] = (uint8_t) ((hi << 4) | lo);
+    }
+    return true;
+}
+
 std::string dockerpack::step::hash() const {
-    toolbox::data::bytes_data out(crypto_hash_sha256_BYTES);
-    const toolbox::data::bytes_data tmp = toolbox::data::bytes_data::from_string_raw(name + command);
-    crypto_hash_sha256(&out[0], &tmp[0], tmp.size());
-    return out.to_hex();
+    return to_hex(m_digest);
+}
+
+const dockerpack::digest_t& dockerpack::step::digest() const {
+    return m_digest;
+}
+
+void dockerpack::step::update_digest() {
+    m_digest = sha256(command);
+}
+
+dockerpack::digest_t dockerpack::step::chain_hash(const digest_t* parent, const std::string& image_id, const env_map& envs, const std::string& workdir) const {
+    // fields are separated by zero byte, envs are sorted to not depend on hash map order
+    std::string data;
+    if (parent) {
+        data.append(reinterpret_cast<const char*>(parent->data()), parent->size());
+    }
+    data.push_back('\0');
+    data.append(image_id).push_back('\0');
+    data.append(workdir).push_back('\0');
+    data.append(reinterpret_cast<const char*>(m_digest.data()), m_digest.size());
+    const std::map<std::string, std::string> sorted_envs(envs.begin(), envs.end());
+    for (const auto& kv : sorted_envs) {
+        data.append(kv.first).append("=").append(kv.second).push_back('\0');
+    }
+    return sha256(data);
+}
+
+const dockerpack::step* dockerpack::step_arena::intern(dockerpack::step&& value) {
+    // all fields separated by zero byte, envs are sorted to not depend on hash map order
+    std::string key;
+    key.append(value.name).push_back('\0');
+    key.append(value.command).push_back('\0');
+    key.append(value.workdir).push_back('\0');
+    key.push_back(value.skip_on_error ? '1' : '0');
+    key.push_back(value.stateless ? '1' : '0');
+    key.push_back(value.checkpoint ? '1' : '0');
+    const std::map<std::string, std::string> sorted_envs(value.envs.begin(), value.envs.end());
+    for (const auto& kv : sorted_envs) {
+        key.append(kv.first).append("=").append(kv.second).push_back('\0');
+    }
+
+    const auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        return it->second;
+    }
+    m_steps.push_back(std::move(value));
+    const step* stored = &m_steps.back();
+    m_index.emplace(std::move(key), stored);
+    return stored;
+}
+
+size_t dockerpack::step_arena::size() const {
+    return m_steps.size();
+}
+
+std::deque<dockerpack::step>::iterator dockerpack::step_arena::begin() {
+    return m_steps.begin();
+}
+
+std::deque<dockerpack::step>::iterator dockerpack::step_arena::end() {
+    return m_steps.end();
 }
 
 std::string dockerpack::job::job_name() const {
@@ -9,6 +9,10 @@
 #ifndef DOCKERPACK_DATA_H
 #define DOCKERPACK_DATA_H
 
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -19,21 +23,42 @@ namespace dockerpack {
 
 using env_map = std::unordered_map<std::string, std::string>;
 
+/// \brief Binary sha256 digest
+using digest_t = std::array<uint8_t, 32>;
+
+/// \brief Digest is already uniformly distributed, so it's first bytes are a good hash
+struct digest_hasher {
+    size_t operator()(const digest_t& digest) const noexcept {
+        size_t out;
+        std::memcpy(&out, digest.data(), sizeof(out));
+        return out;
+    }
+};
+
+digest_t sha256(const std::string& data);
+std::string to_hex(const digest_t& digest);
+/// \return false if value is not a hex encoded digest
+bool from_hex(const std::string& value, digest_t& digest);
+
 struct docker_image {
     std::string repo;
     std::string tag;
+    // short (12 chars) image id
+    std::string id;
 };
 
-class step : public std::enable_shared_from_this<dockerpack::step> {
+class step {
 public:
     std::string name;
     std::string command;
     bool skip_on_error = false;
     bool stateless = false;
+    // commit container to snapshot image after this step
+    bool checkpoint = false;
     std::string workdir;
     env_map envs;
 
-    std::string to_string() {
+    std::string to_string() const {
         std::stringstream ss;
         if (!name.empty()) {
             ss << name << ": ";
@@ -44,46 +69,65 @@ public:
         return ss.str();
     }
 
+    /// \brief Hex encoded digest of command
     std::string hash() const;
+    /// \brief Digest of command, calculated by update_digest() once config is parsed
+    const digest_t& digest() const;
+    void update_digest();
+    /// \brief Content-addressed key of this step in job steps chain:
+    /// hash(parent key, image id, envs, workdir, command). Changes if this step or any preceding one changes.
+    /// \param parent key of previous step, nullptr for the first one
+    /// \param image_id id of the job image
+    /// \param envs environment the step is executed with
+    /// \param workdir step workdir as it's written in config
+    digest_t chain_hash(const digest_t* parent, const std::string& image_id, const env_map& envs, const std::string& workdir) const;
+
+private:
+    digest_t m_digest{};
 };
 
-struct virtual_enable_shared_from_this_base : std::enable_shared_from_this<virtual_enable_shared_from_this_base> {
-    virtual ~virtual_enable_shared_from_this_base() {
-    }
-};
-template<typename T>
-struct virtual_enable_shared_from_this : virtual virtual_enable_shared_from_this_base {
-    std::shared_ptr<T> shared_from_this() {
-        return std::dynamic_pointer_cast<T>(
-            virtual_enable_shared_from_this_base::shared_from_this());
-    }
+/// \brief Owns all steps of config. Equal steps are stored once, commands and jobs refer to them by pointer,
+/// so thousands of jobs sharing the same commands don't copy steps and their environment.
+/// Steps are never moved or removed, pointers are valid while arena exists.
+class step_arena {
+public:
+    /// \brief Pointer to stored step equal to given one, new step is stored if there is no such
+    const step* intern(step&& value);
+    size_t size() const;
+
+    /// \brief Mutable access for resolving values after parsing, intern() can't be used after steps are changed
+    std::deque<step>::iterator begin();
+    std::deque<step>::iterator end();
+
+private:
+    std::deque<step> m_steps;
+    // step content key -> stored step
+    std::unordered_map<std::string, const step*> m_index;
 };
 
-class job : public virtual_enable_shared_from_this<dockerpack::job> {
+class job {
 public:
     std::string name;
     std::string image;
     env_map envs;
-    std::vector<std::shared_ptr<step>> steps;
+    std::vector<const step*> steps;
+
+    virtual ~job() = default;
 
     std::string job_name() const;
     void add_envs(const dockerpack::env_map& ext_envs);
 };
 
-class image_to_build : public job, public virtual_enable_shared_from_this<dockerpack::image_to_build> {
+class image_to_build : public job {
 public:
     std::string repo;
     std::string tag;
 
     std::string full_name() const;
-
-    std::shared_ptr<image_to_build> shared_from_this() {
-        return virtual_enable_shared_from_this<dockerpack::image_to_build>::shared_from_this();
-    }
 };
 
 using job_ptr_t = std::shared_ptr<dockerpack::job>;
-using step_ptr_t = std::shared_ptr<dockerpack::step>;
+using step_ptr_t = const dockerpack::step*;
 using imb_ptr_t = std::shared_ptr<dockerpack::image_to_build>;
 
 } // namespace dockerpack
@@ -9,89 +9,365 @@
 
 #include "docker.h"
 
+#include "archive.h"
+#include "output.h"
+#include "sync.h"
+#include "trace.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cctype>
 #include <boost/process.hpp>
+#include <fstream>
+#include <nlohmann/json.hpp>
 #include <termcolor/termcolor.hpp>
+#include <thread>
 #include <toolbox/strings.hpp>
 #include <toolbox/strings/regex.h>
 
 namespace style = termcolor;
 
-static std::string exec_internal(const std::string& job_name, const std::string& bash_command) {
-    std::stringstream cmd_builder;
-    cmd_builder << "docker exec ";
-    cmd_builder << job_name << " ";
-    cmd_builder << "bash -c \"";
-    cmd_builder << bash_command;
-    cmd_builder << "\"";
-
-    int status = 0;
-    dockerpack::execmd cmd(cmd_builder.str());
-    std::string res = cmd.run(&status);
-    if (status) {
-        throw std::runtime_error(res);
+void dockerpack::image_inventory::load(const std::vector<docker_image>& images) {
+    m_refs.clear();
+    m_ids.clear();
+    m_refs.reserve(images.size());
+    for (const auto& image : images) {
+        add(image);
     }
+}
 
-    return res;
+void dockerpack::image_inventory::add(const docker_image& image) {
+    m_refs[image.repo + ":" + image.tag] = image.id;
+    if (!image.id.empty()) {
+        m_ids.insert(image.id);
+    }
 }
 
-void dockerpack::docker::ensure_workdir(const dockerpack::job_ptr_t& job, const std::string& workdir) {
-    if (workdir.empty()) {
-        std::cerr << "[debug] can't make cwd: workdir is empty" << std::endl;
-        return;
-    } else if (workdir == "/") {
-        return;
+void dockerpack::image_inventory::remove(const std::string& reference) {
+    const auto repo_tag = split_image_reference(reference);
+    m_refs.erase(repo_tag.first + ":" + repo_tag.second);
+}
+
+bool dockerpack::image_inventory::has(const std::string& repo, const std::string& tag) const {
+    return m_refs.count(repo + ":" + tag);
+}
+
+bool dockerpack::image_inventory::has_id(const std::string& id) const {
+    return m_ids.count(short_image_id(id));
+}
+
+std::string dockerpack::image_inventory::id_of(const std::string& reference) const {
+    const auto repo_tag = split_image_reference(reference);
+    const auto it = m_refs.find(repo_tag.first + ":" + repo_tag.second);
+    if (it == m_refs.end()) {
+        return std::string();
+    }
+    return it->second;
+}
+
+const std::string dockerpack::docker::CHECKPOINT_REPOSITORY = "dockerpack-checkpoint";
+
+/// \brief Job name as a valid docker repository path component: lowercase letters, digits, separators
+static std::string checkpoint_repository(const dockerpack::job_ptr_t& job) {
+    std::string name = toolbox::strings::to_lower_case(job->name);
+    for (char& c : name) {
+        if (!std::isalnum((unsigned char) c) && c != '.' && c != '_' && c != '-') {
+            c = '-';
+        }
+    }
+    return dockerpack::docker::CHECKPOINT_REPOSITORY + "/" + name;
+}
+
+static const std::string FACTS_ENV = "@@dockerpack_env@@";
+static const std::string FACTS_OS = "@@dockerpack_os@@";
+static const std::string FACTS_CPU = "@@dockerpack_cpu@@";
+
+// differ between containers of the same image or set by the probing shell itself, so they are not cached
+static const std::unordered_set<std::string> CONTAINER_ENVS = {"HOSTNAME", "PWD", "OLDPWD", "SHLVL", "_"};
+
+/// \brief Quote path for shell leaving "~" prefix and $NAME references to be expanded in container,
+/// the same way normalize_remote_path() does after bootstrap
+static std::string shell_path(const std::string& path) {
+    std::string out;
+    size_t pos = 0;
+    if (!path.empty() && path[0] == '~' && (path.size() == 1 || path[1] == '/')) {
+        out = "\"$HOME\"";
+        pos = 1;
+    }
+    std::string literal;
+    const auto flush = [&out, &literal]() {
+        if (!literal.empty()) {
+            out += dockerpack::utils::shell_quote(literal);
+            literal.clear();
+        }
+    };
+    while (pos < path.size()) {
+        size_t end = pos + 1;
+        if (path[pos] == '$' && end < path.size() && path[end] == '{' && path.find('}', end) != std::string::npos) {
+            end = path.find('}', end) + 1;
+        }
+        while (path[pos] == '$' && end < path.size() && (std::isalnum((unsigned char) path[end]) || path[end] == '_')) {
+            end++;
+        }
+        if (end > pos + 1) {
+            flush();
+            out += "\"" + path.substr(pos, end - pos) + "\"";
+        } else {
+            literal.push_back(path[pos]);
+        }
+        pos = end;
+    }
+    flush();
+    return out;
+}
+
+static std::string facts_cache_path(const std::string& image_id) {
+    return dockerpack::utils::cache_dir("bootstrap") + "/" + image_id + ".json";
+}
+
+static bool load_cached_facts(const std::string& image_id, dockerpack::container_facts& facts) {
+    std::ifstream is(facts_cache_path(image_id));
+    if (!is.is_open()) {
+        return false;
+    }
+    const auto j = nlohmann::json::parse(is, nullptr, false);
+    if (j.is_discarded() || !j.is_object()) {
+        return false;
     }
-    std::stringstream cmd_builder;
-    cmd_builder << "docker exec ";
+    facts.envs = j.value("envs", dockerpack::env_map());
+    // written by previous versions
+    for (const auto& name : CONTAINER_ENVS) {
+        facts.envs.erase(name);
+    }
+    facts.home = j.value("home", "");
+    facts.os_release = j.value("os_release", "");
+    facts.cpu_count = j.value("cpu_count", (size_t) 0);
+    return true;
+}
 
-    if (!job->envs.empty()) {
-        for (const auto& kv : job->envs) {
-            cmd_builder << "-e " << kv.first << "=" << kv.second << " ";
+static void save_cached_facts(const std::string& image_id, const dockerpack::container_facts& facts) {
+    nlohmann::json j;
+    j["envs"] = facts.envs;
+    j["home"] = facts.home;
+    j["os_release"] = facts.os_release;
+    j["cpu_count"] = facts.cpu_count;
+    dockerpack::utils::write_file_atomic(facts_cache_path(image_id), j.dump());
+}
+
+static dockerpack::container_facts parse_facts(const std::string& probe) {
+    dockerpack::container_facts facts;
+    std::string section;
+    for (const auto& line : toolbox::strings::split(probe, "\n")) {
+        if (line == FACTS_ENV || line == FACTS_OS || line == FACTS_CPU) {
+            section = line;
+            continue;
         }
+        if (line.empty()) {
+            continue;
+        }
+
+        if (section == FACTS_ENV) {
+            auto pair = toolbox::strings::split_pair(line, "=");
+            facts.envs[pair.first] = pair.second;
+        } else if (section == FACTS_OS) {
+            auto pair = toolbox::strings::split_pair(line, "=");
+            if (pair.first == "PRETTY_NAME") {
+                facts.os_release = pair.second;
+                facts.os_release.erase(std::remove(facts.os_release.begin(), facts.os_release.end(), '"'), facts.os_release.end());
+            }
+        } else if (section == FACTS_CPU) {
+            try {
+                facts.cpu_count = std::stoul(line);
+            } catch (const std::exception&) {
+                facts.cpu_count = 0;
+            }
+        }
+    }
+    if (facts.envs.count("HOME")) {
+        facts.home = facts.envs.at("HOME");
     }
+    return facts;
+}
 
-    cmd_builder << job->job_name() << " ";
-    cmd_builder << "bash -c \"";
-    cmd_builder << "mkdir -p " << workdir;
-    cmd_builder << "\"";
+std::string dockerpack::docker::image_id_of(const std::string& image) {
+    ensure_inventory();
+    std::lock_guard<std::mutex> lock(m_inventory_lock);
+    std::string id = m_inventory.id_of(image);
+    if (id.empty()) {
+        // image was pulled by "docker run" after inventory had been loaded
+        m_inventory.load(images());
+        id = m_inventory.id_of(image);
+    }
+    return id;
+}
+
+void dockerpack::docker::bootstrap(const dockerpack::job_ptr_t& job) {
+    trace_span span("bootstrap", "docker");
+    std::unordered_set<std::string> raw_workdirs;
+    if (!m_config->workdir.empty()) {
+        raw_workdirs.insert(m_config->workdir);
+    }
+    for (const auto& step : job->steps) {
+        if (!step->workdir.empty()) {
+            raw_workdirs.insert(step->workdir);
+        }
+    }
+    raw_workdirs.erase("/");
+
+    const std::string image_id = m_config->bootstrap_cache ? image_id_of(job->image) : std::string();
+
+    container_facts facts;
+    const bool cached = !image_id.empty() && load_cached_facts(image_id, facts);
+    if (!cached) {
+        std::stringstream script;
+        if (!raw_workdirs.empty()) {
+            script << "mkdir -p";
+            for (const auto& workdir : raw_workdirs) {
+                script << " " << shell_path(workdir);
+            }
+            script << "; ";
+        }
+        script << "echo " << FACTS_ENV << "; env; ";
+        script << "echo " << FACTS_OS << "; cat /etc/os-release 2>/dev/null; ";
+        script << "echo " << FACTS_CPU << "; nproc 2>/dev/null || getconf _NPROCESSORS_ONLN";
+
+        facts = parse_facts(backend().exec_output(job->job_name(), script.str()));
+
+        if (!image_id.empty()) {
+            // global and job envs are passed to every container separately, they are not image facts
+            container_facts image_facts = facts;
+            for (const auto& kv : container_envs(job)) {
+                image_facts.envs.erase(kv.first);
+            }
+            for (const auto& name : CONTAINER_ENVS) {
+                image_facts.envs.erase(name);
+            }
+            try {
+                save_cached_facts(image_id, image_facts);
+            } catch (const std::exception& e) {
+                dockerpack::output(output_prefix(job), std::cerr) << "Unable to cache container facts: " << e.what() << std::endl;
+            }
+        }
+    } else {
+        for (const auto& kv : container_envs(job)) {
+            facts.envs[kv.first] = kv.second;
+        }
+        // docker sets short container id as hostname
+        std::lock_guard<std::mutex> lock(m_lock);
+        const auto it = m_run_jobs.find(job->job_name());
+        if (it != m_run_jobs.end() && it->second.size() >= 12) {
+            facts.envs["HOSTNAME"] = it->second.substr(0, 12);
+        }
+    }
 
     if (m_config->debug) {
-        std::cout << "[debug] make cwd: " << style::green << cmd_builder.str() << style::reset << std::endl;
+        dockerpack::output(output_prefix(job))
+            << "[debug] container: " << style::green << facts.os_release << ", " << facts.cpu_count << " cpu, home " << facts.home
+            << (cached ? " (cached)" : "") << style::reset << std::endl;
     }
 
-    dockerpack::execmd cmd(cmd_builder.str());
-    int status = 0;
-    const std::string result = cmd.run(&status);
-    if (status) {
-        throw std::runtime_error("unable to create " + workdir);
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_facts[job->job_name()] = std::move(facts);
+        m_workdirs[job->job_name()].clear();
+    }
+
+    if (!cached) {
+        std::unordered_set<std::string> created;
+        for (std::string workdir : raw_workdirs) {
+            normalize_remote_path(job, workdir);
+            created.insert(std::move(workdir));
+        }
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_workdirs[job->job_name()] = std::move(created);
     }
 }
 
 bool dockerpack::docker::check_docker_exists() {
-    namespace bp = boost::process;
-    auto path = bp::search_path("docker");
-    return !path.empty();
+    return dockerpack::cli_backend::available();
 }
 
 dockerpack::docker::docker(std::shared_ptr<dockerpack::config> config)
     : m_config(std::move(config)) {
 }
 
-void dockerpack::docker::normalize_remote_path(std::string& path) const {
-    for (const auto& env_value : image_envs) {
+dockerpack::docker::~docker() {
+    m_sessions.clear();
+    if (m_events_watcher.joinable()) {
+        m_backend->stop_events();
+        m_events_watcher.join();
+    }
+}
+
+void dockerpack::docker::init() {
+    m_backend = dockerpack::make_backend(*m_config);
+
+    if (m_config->watch_events) {
+        // containers removed outside of dockerpack are forgotten immediately
+        m_events_watcher = std::thread([this]() {
+            m_backend->watch_events([this](const container_event& event) {
+                on_container_event(event);
+            });
+        });
+    }
+}
+
+void dockerpack::docker::on_container_event(const container_event& event) {
+    if (!toolbox::strings::has_substring("_dockerpack", event.container.name)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (event.action == "create") {
+        m_run_jobs[event.container.name] = event.container.id;
+    } else if (event.action == "destroy") {
+        m_run_jobs.erase(event.container.name);
+        m_facts.erase(event.container.name);
+        m_workdirs.erase(event.container.name);
+    }
+}
+
+dockerpack::docker_backend& dockerpack::docker::backend() {
+    if (!m_backend) {
+        throw std::logic_error("docker backend is not initialized, call docker::init() after config parsing");
+    }
+    return *m_backend;
+}
+
+void dockerpack::docker::prefix_output(bool enable) {
+    m_prefix_output = enable;
+}
+
+std::string dockerpack::docker::output_prefix(const dockerpack::job_ptr_t& job) const {
+    if (!m_prefix_output) {
+        return std::string();
+    }
+    return "[" + job->name + "] ";
+}
+
+void dockerpack::docker::normalize_remote_path(const dockerpack::job_ptr_t& job, std::string& path) const {
+    env_map envs;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_facts.count(job->job_name())) {
+            envs = m_facts.at(job->job_name()).envs;
+        }
+    }
+
+    for (const auto& env_value : envs) {
         if (toolbox::strings::has_substring(env_value.first, path)) {
             toolbox::strings::replace(env_value.first, env_value.second, path);
         }
     }
 
-    if (toolbox::strings::has_substring("~", path) && image_envs.count("HOME")) {
-        toolbox::strings::replace("~", image_envs.at("HOME"), path);
+    if (toolbox::strings::has_substring("~", path) && envs.count("HOME")) {
+        toolbox::strings::replace("~", envs.at("HOME"), path);
     }
 
     if (m_config->debug) {
-        std::cout << "[debug] Normalize path: " << path << std::endl;
+        dockerpack::output(output_prefix(job)) << "[debug] Normalize path: " << path << std::endl;
     }
 }
 
@@ -136,138 +412,417 @@ void dockerpack::docker::copy(const dockerpack::job_ptr_t& job, const std::strin
     }
     toolbox::strings::trim_ref(path_segments.second);
     normalize_local_path(path_segments.first);
-    normalize_remote_path(path_segments.second);
+    normalize_remote_path(job, path_segments.second);
 
-    if (!toolbox::strings::has_substring("$image", path_segments.second)) {
-        path_segments.second = job->job_name() + ":" + path_segments.second;
+    // "$image:/path" is the same as "/path"
+    std::string remote_path = path_segments.second;
+    if (toolbox::strings::has_substring("$image:", remote_path)) {
+        toolbox::strings::replace("$image:", "", remote_path);
+    }
+
+    if (m_config->debug) {
+        dockerpack::output(output_prefix(job)) << "[debug] copy: " << path_segments.first << " " << job->job_name() << ":" << remote_path << std::endl;
+    }
+    if (!boost::filesystem::is_directory(path_segments.first)) {
+        trace_span span("docker cp", "docker");
+        backend().copy(path_segments.first, job->job_name(), remote_path);
+    } else if (m_config->sync) {
+        sync_copy(job, path_segments.first, remote_path);
     } else {
-        toolbox::strings::replace("$image", job->job_name(), path_segments.second);
+        stream_copy(job, path_segments.first, remote_path);
     }
+}
 
-    std::stringstream res_path;
-    res_path << path_segments.first << " " << path_segments.second;
+dockerpack::ignore_rules dockerpack::docker::copy_rules(const std::string& local_root) const {
+    ignore_rules rules;
+    rules.load(trim_directory(local_root) + "/" + IGNORE_FILE);
+    for (const auto& pattern : m_config->copy_exclude) {
+        rules.add(pattern);
+    }
+    return rules;
+}
 
-    if (m_config->debug) {
-        std::cout << "[debug] copy: " << res_path.str() << std::endl;
+dockerpack::archive_options dockerpack::docker::copy_options() const {
+    archive_options opts;
+    opts.threads = m_config->copy_threads ? m_config->copy_threads : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    opts.compression = m_config->copy_compression;
+    return opts;
+}
+
+std::string dockerpack::docker::copy_prefix(const dockerpack::job_ptr_t& job, const std::string& local_path, const std::string& remote_path) {
+    const std::string name = boost::filesystem::path(trim_directory(local_path)).filename().string();
+
+    // same as "docker cp": directory itself is copied into existing directory, otherwise it's contents is copied
+    // to the new one. "dir/." is always copied by contents.
+    std::string source = local_path;
+    while (source.size() > 1 && source.back() == '/') {
+        source.pop_back();
     }
-    dockerpack::execmd cmd("docker cp " + res_path.str());
-    int status = 0;
-    const auto res = cmd.run(&status);
-    if (status) {
-        throw std::runtime_error(res);
+    const bool contents_only = name.empty() || name == "." || name == "/" || (source.size() > 2 && source.compare(source.size() - 2, 2, "/.") == 0);
+
+    std::string script = "mkdir -p " + utils::shell_quote(remote_path);
+    if (!contents_only) {
+        script = "[ -d " + utils::shell_quote(remote_path) + " ] && echo exists; " + script;
     }
+    const std::string res = backend().exec_output(job->job_name(), script);
+    return !contents_only && toolbox::strings::has_substring("exists", res) ? name + "/" : "";
 }
-void dockerpack::docker::restore_from_ps() {
-    dockerpack::execmd cmd("docker ps -a --format \"{{.ID}}|{{.Names}}\"");
-    int status = 0;
-    std::string res = cmd.run(&status);
-    if (status) {
-        throw std::runtime_error(res);
+
+void dockerpack::docker::stream_copy(const dockerpack::job_ptr_t& job, const std::string& local_path, const std::string& remote_path) {
+    const std::string root = trim_directory(local_path);
+    const std::string prefix = copy_prefix(job, local_path, remote_path);
+
+    file_tree_t tree;
+    {
+        trace_span span("scan", "docker", root);
+        tree = scan_directory(root, copy_rules(root));
+    }
+    std::vector<std::string> names;
+    names.reserve(tree.size());
+    for (const auto& kv : tree) {
+        names.push_back(kv.first);
     }
-    if (res.empty()) {
+
+    const archive_options opts = copy_options();
+    trace_span span("stream archive", "docker", std::to_string(names.size()) + " entries");
+    backend().copy_stream(job->job_name(), remote_path, [&](std::ostream& os) {
+        write_archive(os, root, tree, names, prefix, opts);
+    });
+}
+
+static std::string sync_manifest_prefix(const std::string& container_id) {
+    return dockerpack::utils::cache_dir("sync") + "/" + container_id.substr(0, 12) + "-";
+}
+
+void dockerpack::docker::sync_copy(const dockerpack::job_ptr_t& job, const std::string& local_path, const std::string& remote_path) {
+    std::string container_id;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        container_id = m_run_jobs.at(job->job_name());
+    }
+
+    // manifest describes what has been copied to this container and directory inside remote path
+    const std::string prefix = copy_prefix(job, local_path, remote_path);
+    const std::string key = to_hex(sha256(local_path + '\0' + remote_path + '\0' + prefix)).substr(0, 16);
+    const std::string manifest_path = sync_manifest_prefix(container_id) + key + ".json";
+
+    dockerpack::dir_sync sync(local_path, prefix, manifest_path, copy_rules(local_path), copy_options().threads);
+    sync_plan plan;
+    {
+        trace_span span("sync plan", "docker", local_path);
+        plan = sync.plan();
+    }
+    if (plan.empty()) {
+        dockerpack::output(output_prefix(job)) << "   - up to date" << std::endl;
         return;
     }
-    std::vector<std::string> lines = toolbox::strings::split(res, "\n");
-    for (const auto& line : lines) {
-        std::vector<std::string> items = toolbox::strings::split(line, "|");
-        if (items.size() != 2) {
-            throw std::runtime_error("Undefined \"docker ps\" result: " + res);
+
+    // remote path is already created by copy_prefix()
+    if (!plan.deleted.empty()) {
+        const std::string target_dir = prefix.empty() ? remote_path : remote_path + "/" + prefix;
+        std::stringstream script;
+        script << "cd " << utils::shell_quote(target_dir) << " && rm -rf --";
+        for (const auto& rel : plan.deleted) {
+            script << " " << utils::shell_quote(rel);
+        }
+        backend().exec_output(job->job_name(), script.str());
+    }
+
+    if (!plan.changed.empty()) {
+        const archive_options opts = copy_options();
+        trace_span span("stream archive", "docker", std::to_string(plan.changed.size()) + " entries");
+        backend().copy_stream(job->job_name(), remote_path, [&sync, &plan, &opts](std::ostream& os) {
+            sync.write_archive(plan, os, opts);
+        });
+    }
+
+    sync.commit();
+    dockerpack::output(output_prefix(job))
+        << "   - synced " << plan.changed.size() << " entries (" << (plan.bytes / 1024) << " KiB), removed " << plan.deleted.size() << std::endl;
+}
+
+void dockerpack::docker::remove_sync_manifests(const std::string& container_id) {
+    const std::string prefix = sync_manifest_prefix(container_id);
+    const boost::filesystem::path dir = boost::filesystem::path(prefix).parent_path();
+    const std::string name_prefix = boost::filesystem::path(prefix).filename().string();
+
+    boost::system::error_code ec;
+    for (boost::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().filename().string().compare(0, name_prefix.size(), name_prefix) == 0) {
+            boost::filesystem::remove(it->path(), ec);
         }
-        if (toolbox::strings::has_substring("_dockerpack", items[1])) {
-            m_run_jobs[items[1]] = items[0];
+    }
+}
+
+void dockerpack::docker::restore_from_ps() {
+    const auto containers = backend().ps();
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_registry_loaded = true;
+    m_run_jobs.clear();
+    for (const auto& container : containers) {
+        if (toolbox::strings::has_substring("_dockerpack", container.name)) {
+            m_run_jobs[container.name] = container.id;
         }
     }
 }
 
-void dockerpack::docker::load_remote_envs(const dockerpack::job_ptr_t& job) {
-    std::string env_result = exec_internal(job->job_name(), "env");
-    if (!env_result.empty()) {
-        std::vector<std::string> env_lines = toolbox::strings::split(env_result, "\n");
-        for (const auto& env_line : env_lines) {
-            auto pair = toolbox::strings::split_pair(env_line, "=");
-            image_envs[pair.first] = pair.second;
+void dockerpack::docker::ensure_registry() {
+    std::lock_guard<std::mutex> load_lock(m_registry_lock);
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_registry_loaded) {
+            return;
         }
     }
+    trace_span span("docker ps", "docker");
+    restore_from_ps();
 }
 
-void dockerpack::docker::run(const dockerpack::job_ptr_t& job) {
+bool dockerpack::docker::run(const dockerpack::job_ptr_t& job, const std::string& image) {
     if (has_running_job(job)) {
-        load_remote_envs(job->shared_from_this());
+        bootstrap(job);
+        return false;
+    }
+
+    std::string image_id;
+    {
+        trace_span span("docker run", "docker", image.empty() ? job->image : image);
+        std::vector<volume_mount> mounts = workspace_mounts(job);
+        for (auto& mount : cache_mounts(job)) {
+            mounts.push_back(std::move(mount));
+        }
+        image_id = backend().run(job->job_name(), image.empty() ? job->image : image, container_envs(job), mounts);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_run_jobs[job->job_name()] = image_id;
+    }
+
+    bootstrap(job);
+    return true;
+}
+
+static std::string workspace_volume(const std::string& job_name) {
+    return job_name + "_workspace";
+}
+
+static std::string workspace_layer_dir(const std::string& job_name) {
+    return dockerpack::utils::cache_dir("workspace") + "/" + job_name;
+}
+
+std::vector<dockerpack::volume_mount> dockerpack::docker::workspace_mounts(const dockerpack::job_ptr_t& job) {
+    std::vector<volume_mount> out;
+    // built images must contain their sources, mounts are not committed
+    if (m_config->workspace == "copy" || std::dynamic_pointer_cast<image_to_build>(job)) {
+        return out;
+    }
+
+    volume_mount mount;
+    mount.target = m_config->workdir;
+    if (m_config->workspace == "mount") {
+        mount.source = m_config->m_cwd;
+        mount.read_only = true;
+        out.push_back(std::move(mount));
+        return out;
+    }
+
+    // overlay: project is the lower layer, job writes to it's own upper layer. Volume is mounted by docker daemon,
+    // so layer directories must be accessible on the daemon host
+    const std::string volume = workspace_volume(job->job_name());
+    const std::string layer_dir = workspace_layer_dir(job->job_name());
+    remove_workspace(job->job_name());
+    boost::filesystem::create_directories(layer_dir + "/upper");
+    boost::filesystem::create_directories(layer_dir + "/work");
+
+    backend().create_volume(volume, {
+                                        {"type", "overlay"},
+                                        {"device", "overlay"},
+                                        {"o", "lowerdir=" + m_config->m_cwd + ",upperdir=" + layer_dir + "/upper,workdir=" + layer_dir + "/work"},
+                                    });
+    mount.source = volume;
+    mount.bind = false;
+    out.push_back(std::move(mount));
+    return out;
+}
+
+void dockerpack::docker::remove_workspace(const std::string& job_name) {
+    if (m_config->workspace != "overlay") {
         return;
     }
+    try {
+        backend().remove_volume(workspace_volume(job_name));
+    } catch (const std::exception&) {
+        // volume does not exist
+    }
+
+    const std::string layer_dir = workspace_layer_dir(job_name);
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(layer_dir, ec);
+    if (ec) {
+        // files created in container may belong to another user
+        dockerpack::output() << style::yellow << "Unable to remove workspace layer " << layer_dir << ": " << ec.message() << style::reset << std::endl;
+    }
+}
 
-    std::stringstream env_builder;
-    for (const auto& entry : job->envs) {
-        env_builder << "-e " << entry.first << "=" << entry.second << " ";
+/// \brief Replace characters which are not allowed in volume names
+static std::string volume_name_part(const std::string& value) {
+    std::string out = value;
+    for (char& c : out) {
+        if (!std::isalnum((unsigned char) c) && c != '_' && c != '.' && c != '-') {
+            c = '_';
+        }
     }
+    return out;
+}
 
-    std::stringstream cmd_builder;
-    cmd_builder << "docker run " << env_builder.str();
-    cmd_builder << "-d -it --name ";
-    cmd_builder << job->job_name() << " " << job->image << " ";
-    cmd_builder << "/bin/bash";
+static std::string expand_cache_template(const std::string& tpl, const dockerpack::job_ptr_t& job, const dockerpack::cache_volume& cache) {
+    std::string out = tpl;
+    toolbox::strings::replace("{image}", volume_name_part(job->image), out);
+    toolbox::strings::replace("{job}", volume_name_part(job->name), out);
+    toolbox::strings::replace("{name}", volume_name_part(cache.name), out);
+    return out;
+}
 
-    if (m_config->debug) {
-        std::cout << "[debug] run: " << style::green << cmd_builder.str() << style::reset << std::endl;
+std::vector<dockerpack::volume_mount> dockerpack::docker::cache_mounts(const dockerpack::job_ptr_t& job) const {
+    std::vector<volume_mount> out;
+    for (const auto& cache : m_config->caches) {
+        volume_mount mount;
+        mount.target = cache.path;
+        if (cache.host_path.empty()) {
+            // named volume is created by docker on first mount
+            const std::string key = expand_cache_template(cache.key, job, cache);
+            mount.source = "dockerpack-cache-" + volume_name_part(cache.name) + (key.empty() ? "" : "-" + volume_name_part(key));
+            mount.bind = false;
+        } else {
+            mount.source = expand_cache_template(cache.host_path, job, cache);
+            boost::filesystem::create_directories(mount.source);
+        }
+        out.push_back(std::move(mount));
     }
+    return out;
+}
 
-    int status = 0;
-    dockerpack::execmd cmd(cmd_builder.str());
-    const std::string res = cmd.run(&status);
-    if (status) {
-        throw std::runtime_error(res);
+void dockerpack::docker::prune_caches(const dockerpack::job_ptr_t& job) {
+    for (const auto& cache : m_config->caches) {
+        if (!cache.max_size) {
+            continue;
+        }
+
+        // remove least recently accessed files until cache fits max_size. du counts disk usage, so result is approximate
+        std::stringstream script;
+        script << "set -f; IFS=$'\n'; d=" << utils::shell_quote(cache.path) << "; [ -d $d ] || exit 0; ";
+        script << "total=$(( $(du -sk $d | cut -f1) * 1024 )); [ $total -le " << cache.max_size << " ] && exit 0; ";
+        script << "for line in $(find $d -type f -exec stat -c '%X %s %n' {} + | sort -n); do ";
+        script << "[ $total -le " << cache.max_size << " ] && break; ";
+        script << "s=${line#* }; s=${s%% *}; rm -f -- ${line#* * }; total=$((total - s)); done; ";
+        script << "echo pruned $total";
+
+        const std::string res = backend().exec_output(job->job_name(), script.str());
+        if (toolbox::strings::has_substring("pruned", res)) {
+            dockerpack::output(output_prefix(job)) << " - cache " << style::green << cache.name << style::reset << " pruned to " << cache.max_size / (1024 * 1024) << " MiB" << std::endl;
+        }
     }
-    const std::string image_id = toolbox::strings::substr_replace_all_ret({"\n", "\t", "\r"}, {"", "", ""}, res);
-    m_run_jobs[job->job_name()] = image_id;
+}
 
-    load_remote_envs(job->shared_from_this());
+dockerpack::env_map dockerpack::docker::container_envs(const dockerpack::job_ptr_t& job) const {
+    env_map envs = m_config->global_envs;
+    for (const auto& kv : job->envs) {
+        envs[kv.first] = kv.second;
+    }
+    return envs;
 }
 
-void dockerpack::docker::exec(const dockerpack::job_ptr_t& job, const dockerpack::step_ptr_t& step) {
-    if (!has_running_job(job)) {
-        throw std::runtime_error("Image " + job->job_name() + " is not run");
+dockerpack::env_map dockerpack::docker::exec_envs(const dockerpack::job_ptr_t& job, const dockerpack::step_ptr_t& step) const {
+    // job envs have priority over step envs, step envs - over global ones
+    env_map envs = m_config->global_envs;
+    for (const auto& kv : step->envs) {
+        envs[kv.first] = kv.second;
+    }
+    for (const auto& kv : job->envs) {
+        envs[kv.first] = kv.second;
     }
+    return envs;
+}
 
-    std::stringstream cmd_builder;
-    cmd_builder << "docker exec ";
-    std::string workdir;
+std::string dockerpack::docker::step_workdir(const dockerpack::step_ptr_t& step) const {
     if (!step->workdir.empty()) {
-        workdir = step->workdir;
-    } else if (!m_config->workdir.empty()) {
-        workdir = m_config->workdir;
+        return step->workdir;
     }
+    return m_config->workdir;
+}
 
-    if (!workdir.empty()) {
-        normalize_remote_path(workdir);
-        cmd_builder << "-w " << workdir << " ";
-        ensure_workdir(job, workdir);
+std::vector<dockerpack::digest_t> dockerpack::docker::step_keys(const dockerpack::job_ptr_t& job) {
+    const std::string image_id = image_id_of(job->image);
+    if (image_id.empty()) {
+        throw std::runtime_error("Image " + job->image + " is not found");
     }
 
-    if (!step->envs.empty()) {
-        for (const auto& kv : step->envs) {
-            cmd_builder << "-e " << kv.first << "=" << kv.second << " ";
-        }
+    // workdir and envs are resolved inside container, so their unresolved values and image id define the result
+    std::vector<digest_t> out;
+    out.reserve(job->steps.size());
+    for (const auto& step : job->steps) {
+        out.push_back(step->chain_hash(out.empty() ? nullptr : &out.back(), image_id, exec_envs(job, step), step_workdir(step)));
+    }
+    return out;
+}
+
+void dockerpack::docker::exec(const dockerpack::job_ptr_t& job, const dockerpack::step_ptr_t& step, const std::string& log_path) {
+    if (!has_running_job(job)) {
+        throw std::runtime_error("Image " + job->job_name() + " is not run");
     }
-    if (!job->envs.empty()) {
-        for (const auto& kv : job->envs) {
-            cmd_builder << "-e " << kv.first << "=" << kv.second << " ";
+
+    exec_options opts;
+    opts.command = step->command;
+    opts.output = m_config->commands_verbose;
+    opts.prefix = output_prefix(job);
+
+    std::string workdir = step_workdir(step);
+
+    bool create_workdir = false;
+    if (!workdir.empty()) {
+        normalize_remote_path(job, workdir);
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            create_workdir = workdir != "/" && !m_workdirs[job->job_name()].count(workdir);
+        }
+
+        if (create_workdir && !m_config->session) {
+            // workdir is not created by bootstrap: create it in the same exec, "docker exec -w" requires existing directory
+            const std::string quoted = utils::shell_quote(workdir);
+            opts.command = "mkdir -p " + quoted + " && cd " + quoted + " || exit 1; " + opts.command;
+        } else {
+            // session creates workdir itself in the same step script
+            opts.workdir = workdir;
         }
     }
 
-    cmd_builder << job->job_name() << " ";
-    cmd_builder << "bash -c \"";
-    cmd_builder << step->command;
-    cmd_builder << "\"";
+    opts.envs = exec_envs(job, step);
 
-    std::string res = cmd_builder.str();
+    std::unique_ptr<log_file> log;
+    if (!log_path.empty()) {
+        log = std::make_unique<log_file>(log_path);
+        log->write("$ " + step->command);
+        opts.log = log.get();
+    }
 
-    if (m_config->debug) {
-        std::cout << "[debug] exec: " << style::green << cmd_builder.str() << style::reset << std::endl;
+    int status;
+    try {
+        if (m_config->session) {
+            status = session(job).exec(opts);
+        } else {
+            status = backend().exec(job->job_name(), opts);
+        }
+    } catch (const std::exception&) {
+        if (step->skip_on_error) {
+            return;
+        }
+        throw;
     }
 
-    dockerpack::exec_stream cmd(cmd_builder.str());
-    cmd.run(m_config->commands_verbose);
-    int status = cmd.wait();
+    if (create_workdir && status == 0) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_workdirs[job->job_name()].insert(workdir);
+    }
 
     if (step->skip_on_error) {
         // ignore status checking
@@ -275,34 +830,66 @@ void dockerpack::docker::exec(const dockerpack::job_ptr_t& job, const dockerpack
     }
 
     if (status) {
-        const auto ec = cmd.error_code();
-        if (ec) {
-            throw std::runtime_error(ec.message());
-        } else {
-            throw std::runtime_error("Unknown error. Exit code: " + std::to_string(status));
-        }
+        throw std::runtime_error("Unknown error. Exit code: " + std::to_string(status));
     }
 }
 void dockerpack::docker::stop(const dockerpack::job_ptr_t& job) {
     stop(job->job_name());
 }
 
+dockerpack::shell_session& dockerpack::docker::session(const dockerpack::job_ptr_t& job) {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        const auto it = m_sessions.find(job->job_name());
+        if (it != m_sessions.end() && it->second->alive()) {
+            return *it->second;
+        }
+    }
+
+    // shell is started outside of lock: it spawns "docker exec"
+    std::unique_ptr<dockerpack::shell_session> created = std::make_unique<dockerpack::shell_session>(job->job_name(), container_envs(job), m_config->debug);
+    std::unique_ptr<dockerpack::shell_session> dead;
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto& s = m_sessions[job->job_name()];
+    if (!s || !s->alive()) {
+        // dead shell is destroyed after unlock, it waits for bash exit
+        dead = std::move(s);
+        s = std::move(created);
+    }
+    return *s;
+}
+
+void dockerpack::docker::close_session(const std::string& job_name) {
+    std::unique_ptr<dockerpack::shell_session> s;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_sessions.count(job_name)) {
+            return;
+        }
+        s = std::move(m_sessions.at(job_name));
+        m_sessions.erase(job_name);
+    }
+    // shell is closed outside of lock: it waits for bash exit
+    s.reset();
+}
+
 void dockerpack::docker::stop(const std::string& job_name) {
+    close_session(job_name);
     if (!has_running_job(job_name)) {
         return;
     }
 
-    int status = 0;
+    trace_span span("docker stop", "docker");
+    backend().stop(job_name);
+}
 
-    if (m_config->debug) {
-        std::cout << "[debug] stop: " << style::green << "docker stop " << job_name << style::reset << std::endl;
+void dockerpack::docker::interrupt(const dockerpack::job_ptr_t& job) {
+    if (!has_running_job(job->job_name())) {
+        return;
     }
 
-    dockerpack::execmd cmd("docker stop " + job_name);
-    const std::string res = cmd.run(&status);
-    if (status) {
-        throw std::runtime_error(res);
-    }
+    trace_span span("docker stop", "docker");
+    backend().stop(job->job_name());
 }
 
 void dockerpack::docker::rm(const dockerpack::job_ptr_t& job) {
@@ -313,56 +900,103 @@ void dockerpack::docker::rm(const std::string& job_name) {
     if (!has_running_job(job_name)) {
         return;
     }
-    if (m_config->debug) {
-        std::cout << "[debug] rm: " << style::green << "docker rm " << job_name << style::reset << std::endl;
+    {
+        trace_span span("docker rm", "docker");
+        backend().rm(job_name);
+        remove_workspace(job_name);
     }
-    dockerpack::execmd cmd("docker rm " + job_name);
-    int status = 0;
-    cmd.run(&status);
 
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_config->sync && m_run_jobs.count(job_name)) {
+        remove_sync_manifests(m_run_jobs.at(job_name));
+    }
     m_run_jobs.erase(job_name);
+    m_facts.erase(job_name);
+    m_workdirs.erase(job_name);
 }
 
-bool dockerpack::docker::has_image(const std::string& repo, const std::string& tag) const {
-    const auto list = images();
-    return std::any_of(list.begin(), list.end(), [repo, tag](const docker_image& image) {
-        return image.repo == repo && image.tag == tag;
-    });
+void dockerpack::docker::ensure_inventory() {
+    std::lock_guard<std::mutex> lock(m_inventory_lock);
+    if (m_inventory_loaded) {
+        return;
+    }
+    trace_span span("docker images", "docker");
+    m_inventory.load(images());
+    m_inventory_loaded = true;
 }
 
-std::vector<dockerpack::docker_image> dockerpack::docker::images() const {
-    dockerpack::execmd cmd("docker images --format {{.Repository}}:{{.Tag}}");
-    int status = 0;
-    const std::string result = cmd.run(&status);
-    if (status || result.empty()) {
-        return std::vector<dockerpack::docker_image>(0);
-    }
+bool dockerpack::docker::has_image(const std::string& repo, const std::string& tag) {
+    ensure_inventory();
+    std::lock_guard<std::mutex> lock(m_inventory_lock);
+    return m_inventory.has(repo, tag);
+}
+
+std::vector<dockerpack::docker_image> dockerpack::docker::images() {
+    return backend().images();
+}
 
-    std::vector<std::string> lines = toolbox::strings::split(result, "\n");
-    std::vector<dockerpack::docker_image> out;
-    out.reserve(lines.size());
-    for (const std::string& line : lines) {
-        std::vector<std::string> parts = toolbox::strings::split(line, ":");
-        out.push_back(dockerpack::docker_image{
-            parts[0],
-            parts[1]});
+void dockerpack::docker::pull(const std::string& reference) {
+    {
+        trace_span span("docker pull", "docker", reference);
+        backend().pull(reference);
     }
-    return out;
+
+    // image id is unknown until "docker images", concurrent pulls are followed by a single reload
+    std::lock_guard<std::mutex> lock(m_inventory_lock);
+    m_inventory_loaded = false;
 }
 
 void dockerpack::docker::commit(const dockerpack::imb_ptr_t& image) {
-    std::stringstream ss;
-    ss << "docker commit ";
-    ss << image->job_name() << " ";
-    ss << image->full_name() << ":" << image->tag;
-    dockerpack::execmd cmd(ss.str());
-    int status = 0;
-    const std::string result = cmd.run(&status);
+    trace_span span("docker commit", "docker", image->full_name() + ":" + image->tag);
+    const std::string id = backend().commit(image->job_name(), image->full_name(), image->tag);
+
+    std::lock_guard<std::mutex> lock(m_inventory_lock);
+    m_inventory.add(docker_image{image->full_name(), image->tag, id});
+}
+
+bool dockerpack::docker::has_image(const std::string& reference) {
+    ensure_inventory();
+    std::lock_guard<std::mutex> lock(m_inventory_lock);
+    return !m_inventory.id_of(reference).empty();
+}
+
+std::string dockerpack::docker::checkpoint(const dockerpack::job_ptr_t& job, const std::string& tag) {
+    const std::string repo = checkpoint_repository(job);
+    trace_span span("docker commit", "docker", repo + ":" + tag);
+    const std::string id = backend().commit(job->job_name(), repo, tag);
+
+    std::lock_guard<std::mutex> lock(m_inventory_lock);
+    m_inventory.add(docker_image{repo, tag, id});
+    return repo + ":" + tag;
+}
+
+void dockerpack::docker::remove_image(const std::string& reference) {
+    backend().remove_image(reference);
+
+    std::lock_guard<std::mutex> lock(m_inventory_lock);
+    m_inventory.remove(reference);
+}
+
+size_t dockerpack::docker::remove_checkpoints(const std::string& name_filter) {
+    const std::string prefix = CHECKPOINT_REPOSITORY + "/";
+    size_t removed = 0;
+    for (const auto& image : images()) {
+        if (image.repo.find(prefix) != 0) {
+            continue;
+        }
+        if (!name_filter.empty() && !toolbox::strings::has_substring(toolbox::strings::to_lower_case(name_filter), image.repo)) {
+            continue;
+        }
+        remove_image(image.repo + ":" + image.tag);
+        removed++;
+    }
+    return removed;
 }
 
 std::vector<std::string> dockerpack::docker::filter_running_job(const std::string& name_filter) {
     restore_from_ps();
     std::vector<std::string> out;
+    std::lock_guard<std::mutex> lock(m_lock);
     for (const auto& kv : m_run_jobs) {
         if (toolbox::strings::has_substring(name_filter, kv.first) || toolbox::strings::has_substring(name_filter, kv.second)) {
             out.push_back(kv.first);
@@ -372,11 +1006,11 @@ std::vector<std::string> dockerpack::docker::filter_running_job(const std::strin
 }
 
 bool dockerpack::docker::has_running_job(const std::string& job_name) {
-    restore_from_ps();
+    ensure_registry();
+    std::lock_guard<std::mutex> lock(m_lock);
     return m_run_jobs.count(job_name);
 }
 
 bool dockerpack::docker::has_running_job(const dockerpack::job_ptr_t& job) {
-    restore_from_ps();
-    return m_run_jobs.count(job->job_name());
+    return has_running_job(job->job_name());
 }
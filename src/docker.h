@@ -9,44 +9,166 @@
 #ifndef DOCKERPACK_DOCKER_H
 #define DOCKERPACK_DOCKER_H
 
+#include "archive.h"
 #include "config.h"
 #include "data.h"
+#include "docker_backend.h"
 #include "execmd.h"
+#include "ignore.h"
+#include "session.h"
 
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace dockerpack {
 
+/// \brief Snapshot of local images: repository:tag and image id lookups
+class image_inventory {
+public:
+    void load(const std::vector<docker_image>& images);
+    void add(const docker_image& image);
+    /// \brief Forget repository:tag reference, image id is kept as it may be referenced by another tag
+    void remove(const std::string& reference);
+    bool has(const std::string& repo, const std::string& tag) const;
+    bool has_id(const std::string& id) const;
+    /// \return short image id or empty string if image is not found
+    std::string id_of(const std::string& reference) const;
+
+private:
+    // repository:tag -> short id
+    std::unordered_map<std::string, std::string> m_refs;
+    std::unordered_set<std::string> m_ids;
+};
+
+/// \brief Container facts collected by bootstrap probe
+struct container_facts {
+    env_map envs;
+    std::string home;
+    std::string os_release;
+    size_t cpu_count = 0;
+};
+
 class docker {
 public:
+    /// \brief Repository of job snapshot images
+    static const std::string CHECKPOINT_REPOSITORY;
+
     static bool check_docker_exists();
 
     explicit docker(std::shared_ptr<dockerpack::config> config);
+    ~docker();
+
+    /// \brief Create backend selected in config. Must be called after config parsing.
+    void init();
+
+    /// \brief Prefix every command output line with "[job name] ". Used when jobs are running concurrently.
+    void prefix_output(bool enable);
 
     void copy(const job_ptr_t& job, const std::string& path);
+    /// \brief Reload container registry from "docker ps -a"
     void restore_from_ps();
-    void run(const job_ptr_t& runner);
-    void exec(const job_ptr_t& job, const step_ptr_t& step);
+    /// \brief Start job container if it's not running yet
+    /// \param image start container from this image instead of job image (snapshot), ignored if container is running
+    /// \return true if new container has been created
+    bool run(const job_ptr_t& runner, const std::string& image = "");
+    /// \param log_path write step output to this file if not empty
+    void exec(const job_ptr_t& job, const step_ptr_t& step, const std::string& log_path = "");
     void stop(const job_ptr_t& job);
     void stop(const std::string& job_name);
+    /// \brief Stop job container to interrupt it's running step. Unlike stop(), job session is not closed,
+    /// so it's safe to call while job is executing in another thread
+    void interrupt(const job_ptr_t& job);
     void rm(const job_ptr_t& job);
     void rm(const std::string& job);
-    std::vector<docker_image> images() const;
-    bool has_image(const std::string& repo, const std::string& tag) const;
+    std::vector<docker_image> images();
+    /// \brief Pull image from registry. Local images snapshot is reloaded on the next lookup
+    void pull(const std::string& reference);
+    /// \brief Lookup in local images snapshot. Snapshot is loaded once and updated by commit()
+    bool has_image(const std::string& repo, const std::string& tag);
+    bool has_image(const std::string& reference);
     void commit(const imb_ptr_t& image);
+    /// \brief Commit job container to snapshot image
+    /// \return snapshot image reference
+    std::string checkpoint(const job_ptr_t& job, const std::string& tag);
+    void remove_image(const std::string& reference);
+    /// \brief Remove least recently used files of shared caches which are larger than their max_size
+    void prune_caches(const job_ptr_t& job);
+    /// \brief Chained content-addressed keys of job steps, see step::chain_hash()
+    /// \throws std::runtime_error if job image is not found locally
+    std::vector<digest_t> step_keys(const job_ptr_t& job);
+    /// \brief Remove snapshot images of jobs matching filter (all if filter is empty)
+    /// \return number of removed images
+    size_t remove_checkpoints(const std::string& name_filter);
     bool has_running_job(const job_ptr_t& job);
     bool has_running_job(const std::string& job_name);
     std::vector<std::string> filter_running_job(const std::string& name_filter);
 
 private:
-    void normalize_remote_path(std::string& path) const;
+    void normalize_remote_path(const dockerpack::job_ptr_t& job, std::string& path) const;
     void normalize_local_path(std::string& path) const;
-    void ensure_workdir(const dockerpack::job_ptr_t& job, const std::string& workdir);
-    void load_remote_envs(const dockerpack::job_ptr_t& job);
+    /// \brief Create remote directory and find where local directory goes by "docker cp" rules
+    /// \return "name/" if directory itself is copied into existing remote directory, empty string if it's contents is copied
+    std::string copy_prefix(const dockerpack::job_ptr_t& job, const std::string& local_path, const std::string& remote_path);
+    /// \brief Copy only changed and deleted entries of local directory since previous sync to the same container
+    void sync_copy(const dockerpack::job_ptr_t& job, const std::string& local_path, const std::string& remote_path);
+    /// \brief Copy local directory as tar stream, skipping ignored entries
+    void stream_copy(const dockerpack::job_ptr_t& job, const std::string& local_path, const std::string& remote_path);
+    /// \brief Patterns of .dockerpackignore in copied directory and copy_exclude config
+    ignore_rules copy_rules(const std::string& local_root) const;
+    archive_options copy_options() const;
+    /// \brief Remove sync manifests of removed container
+    static void remove_sync_manifests(const std::string& container_id);
+    /// \brief Mounts of job workspace. In overlay mode creates fresh workspace volume of the job
+    std::vector<volume_mount> workspace_mounts(const dockerpack::job_ptr_t& job);
+    /// \brief Mounts of config caches: named volumes or host directories, keyed by templates
+    std::vector<volume_mount> cache_mounts(const dockerpack::job_ptr_t& job) const;
+    /// \brief Remove overlay workspace volume and it's upper layer
+    void remove_workspace(const std::string& job_name);
+    /// \brief Environment container is run with: global envs overridden by job envs
+    env_map container_envs(const dockerpack::job_ptr_t& job) const;
+    /// \brief Environment step is executed with: global envs overridden by step envs, step envs - by job envs
+    env_map exec_envs(const dockerpack::job_ptr_t& job, const dockerpack::step_ptr_t& step) const;
+    /// \brief Step workdir as it's written in config, not normalized
+    std::string step_workdir(const dockerpack::step_ptr_t& step) const;
+    /// \brief Collect container facts and create all job workdirs with a single exec.
+    /// Facts are cached on disk by image id, so containers of the same image are not probed again.
+    void bootstrap(const dockerpack::job_ptr_t& job);
+    /// \return short image id or empty string if image is not found locally
+    std::string image_id_of(const std::string& image);
+    /// \brief Load container registry once, later it's updated by run() and rm() and by docker events
+    void ensure_registry();
+    void on_container_event(const container_event& event);
+    void ensure_inventory();
+    /// \brief Persistent shell of the job container, created on first use
+    dockerpack::shell_session& session(const dockerpack::job_ptr_t& job);
+    void close_session(const std::string& job_name);
+    std::string output_prefix(const dockerpack::job_ptr_t& job) const;
+    dockerpack::docker_backend& backend();
     std::shared_ptr<dockerpack::config> m_config;
+    std::unique_ptr<dockerpack::docker_backend> m_backend;
+    // guards m_run_jobs, m_facts and m_workdirs, docker instance is shared between concurrent jobs
+    mutable std::mutex m_lock;
+    bool m_registry_loaded = false;
+    // held while registry is loading, so concurrent callers wait for single "docker ps"
+    // and containers they run are not dropped by stale "docker ps" result
+    std::mutex m_registry_lock;
+    // dockerpack container name -> container id
     std::unordered_map<std::string, std::string> m_run_jobs;
-    env_map image_envs;
-    env_map local_envs;
+    std::thread m_events_watcher;
+    // held while inventory is loading, so concurrent callers wait for single "docker images"
+    std::mutex m_inventory_lock;
+    bool m_inventory_loaded = false;
+    image_inventory m_inventory;
+    // job name -> persistent shell, used if config "session" is enabled
+    std::unordered_map<std::string, std::unique_ptr<dockerpack::shell_session>> m_sessions;
+    // container facts per job name
+    std::unordered_map<std::string, container_facts> m_facts;
+    // already created workdirs per job name
+    std::unordered_map<std::string, std::unordered_set<std::string>> m_workdirs;
+    bool m_prefix_output = false;
 };
 
 } // namespace dockerpack
@@ -0,0 +1,737 @@
+/*!
+ * dockerpack.
+ * docker_api.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "docker_api.h"
+
+#include "archive.h"
+#include "output.h"
+
+#include <array>
+#include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
+#include <cctype>
+#include <nlohmann/json.hpp>
+#include <sys/socket.h>
+#include <termcolor/termcolor.hpp>
+#include <toolbox/strings.hpp>
+
+namespace asio = boost::asio;
+namespace style = termcolor;
+using unix_socket = asio::local::stream_protocol::socket;
+
+const std::string dockerpack::api_backend::API_VERSION = "v1.40";
+
+// HTTP
+
+void dockerpack::http_cancel_token::cancel() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_cancelled = true;
+    if (m_fd != -1) {
+        ::shutdown(m_fd, SHUT_RDWR);
+    }
+}
+
+dockerpack::unix_http_client::unix_http_client(std::string socket_path)
+    : m_socket_path(std::move(socket_path)) {
+}
+
+std::string dockerpack::unix_http_client::url_encode(const std::string& value) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(value.size());
+    for (unsigned char c : value) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            out.push_back((char) c);
+        } else {
+            out.push_back('%');
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 0x0F]);
+        }
+    }
+    return out;
+}
+
+namespace {
+
+/// \brief Writes everything written to it as HTTP/1.1 chunks
+class chunked_streambuf : public std::streambuf {
+public:
+    explicit chunked_streambuf(unix_socket& sock)
+        : m_sock(sock),
+          m_buffer(256 * 1024) {
+        setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+    }
+
+    /// \brief Send the rest of data and the last zero-sized chunk
+    void finish() {
+        send_chunk();
+        write(asio::buffer("0\r\n\r\n", 5));
+    }
+
+    /// \brief Connection was closed by peer while sending
+    bool closed() const {
+        return m_closed;
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        send_chunk();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        send_chunk();
+        return 0;
+    }
+
+private:
+    void send_chunk() {
+        const size_t size = (size_t) (pptr() - pbase());
+        if (size == 0) {
+            return;
+        }
+        std::stringstream head;
+        head << std::hex << size << "\r\n";
+        const std::string head_str = head.str();
+        std::array<asio::const_buffer, 3> buffers = {
+            asio::buffer(head_str),
+            asio::buffer(pbase(), size),
+            asio::buffer("\r\n", 2),
+        };
+        write(buffers);
+        setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+    }
+
+    template<typename Buffers>
+    void write(const Buffers& buffers) {
+        try {
+            asio::write(m_sock, buffers);
+        } catch (const boost::system::system_error&) {
+            m_closed = true;
+            throw;
+        }
+    }
+
+    unix_socket& m_sock;
+    std::vector<char> m_buffer;
+    bool m_closed = false;
+};
+
+} // namespace
+
+dockerpack::http_response dockerpack::unix_http_client::request(const std::string& method, const std::string& target, const std::string& body) {
+    std::string response_body;
+    http_response res = stream(method, target, body, [&response_body](const char* data, size_t size) {
+        response_body.append(data, size);
+    });
+    res.body = std::move(response_body);
+    return res;
+}
+
+static void read_body_chunked(unix_socket& sock, asio::streambuf& buf, const dockerpack::unix_http_client::body_handler_t& handler) {
+    while (true) {
+        const size_t line_len = asio::read_until(sock, buf, "\r\n");
+        std::string size_line(asio::buffers_begin(buf.data()), asio::buffers_begin(buf.data()) + line_len - 2);
+        buf.consume(line_len);
+
+        const size_t chunk_size = std::stoul(size_line, nullptr, 16);
+        if (chunk_size == 0) {
+            // trailing CRLF, connection is closed right after it
+            boost::system::error_code ec;
+            asio::read_until(sock, buf, "\r\n", ec);
+            return;
+        }
+
+        if (buf.size() < chunk_size + 2) {
+            asio::read(sock, buf, asio::transfer_at_least(chunk_size + 2 - buf.size()));
+        }
+        const char* data = asio::buffer_cast<const char*>(buf.data());
+        handler(data, chunk_size);
+        buf.consume(chunk_size + 2);
+    }
+}
+
+static void read_body_sized(unix_socket& sock, asio::streambuf& buf, size_t size, const dockerpack::unix_http_client::body_handler_t& handler) {
+    size_t left = size;
+    while (left > 0) {
+        if (buf.size() == 0) {
+            asio::read(sock, buf, asio::transfer_at_least(1));
+        }
+        const size_t n = std::min(left, buf.size());
+        handler(asio::buffer_cast<const char*>(buf.data()), n);
+        buf.consume(n);
+        left -= n;
+    }
+}
+
+static void read_body_until_eof(unix_socket& sock, asio::streambuf& buf, const dockerpack::unix_http_client::body_handler_t& handler) {
+    boost::system::error_code ec;
+    while (true) {
+        if (buf.size() > 0) {
+            handler(asio::buffer_cast<const char*>(buf.data()), buf.size());
+            buf.consume(buf.size());
+        }
+        asio::read(sock, buf, asio::transfer_at_least(1), ec);
+        if (ec == asio::error::eof) {
+            break;
+        } else if (ec) {
+            throw boost::system::system_error(ec);
+        }
+    }
+    if (buf.size() > 0) {
+        handler(asio::buffer_cast<const char*>(buf.data()), buf.size());
+        buf.consume(buf.size());
+    }
+}
+
+dockerpack::http_response dockerpack::unix_http_client::stream(const std::string& method, const std::string& target, const std::string& body, const body_handler_t& handler, http_cancel_token* cancel) {
+    asio::io_context io;
+    unix_socket sock(io);
+    try {
+        sock.connect(asio::local::stream_protocol::endpoint(m_socket_path));
+    } catch (const boost::system::system_error& e) {
+        throw std::runtime_error("Unable to connect to " + m_socket_path + ": " + e.what());
+    }
+
+    // token must forget the descriptor before the socket is closed
+    struct cancel_registration {
+        http_cancel_token* token;
+        ~cancel_registration() {
+            if (token) {
+                std::lock_guard<std::mutex> lock(token->m_lock);
+                token->m_fd = -1;
+            }
+        }
+    } registration{cancel};
+    if (cancel) {
+        std::lock_guard<std::mutex> lock(cancel->m_lock);
+        if (cancel->m_cancelled) {
+            return http_response();
+        }
+        cancel->m_fd = sock.native_handle();
+    }
+
+    std::stringstream req;
+    req << method << " " << target << " HTTP/1.1\r\n";
+    req << "Host: docker\r\n";
+    req << "User-Agent: dockerpack/" << DOCKERPACK_VERSION << "\r\n";
+    if (!body.empty()) {
+        req << "Content-Type: application/json\r\n";
+    }
+    if (!body.empty() || method == "POST" || method == "PUT") {
+        req << "Content-Length: " << body.size() << "\r\n";
+    }
+    req << "Connection: close\r\n\r\n";
+    req << body;
+    asio::write(sock, asio::buffer(req.str()));
+
+    return read_response(sock, method, handler);
+}
+
+dockerpack::http_response dockerpack::unix_http_client::upload(const std::string& method, const std::string& target, const std::string& content_type, const body_writer_t& writer) {
+    asio::io_context io;
+    unix_socket sock(io);
+    try {
+        sock.connect(asio::local::stream_protocol::endpoint(m_socket_path));
+    } catch (const boost::system::system_error& e) {
+        throw std::runtime_error("Unable to connect to " + m_socket_path + ": " + e.what());
+    }
+
+    std::stringstream req;
+    req << method << " " << target << " HTTP/1.1\r\n";
+    req << "Host: docker\r\n";
+    req << "User-Agent: dockerpack/" << DOCKERPACK_VERSION << "\r\n";
+    req << "Content-Type: " << content_type << "\r\n";
+    req << "Transfer-Encoding: chunked\r\n";
+    req << "Connection: close\r\n\r\n";
+    asio::write(sock, asio::buffer(req.str()));
+
+    chunked_streambuf chunks(sock);
+    try {
+        std::ostream os(&chunks);
+        os.exceptions(std::ios::badbit);
+        writer(os);
+        os.flush();
+        chunks.finish();
+    } catch (...) {
+        if (!chunks.closed()) {
+            // request is not complete, daemon will discard it
+            boost::system::error_code ec;
+            sock.close(ec);
+            throw;
+        }
+        // daemon closed connection before the whole body is sent, probably it's an error response
+    }
+
+    std::string response_body;
+    http_response res = read_response(sock, method, [&response_body](const char* data, size_t size) {
+        response_body.append(data, size);
+    });
+    res.body = std::move(response_body);
+    if (chunks.closed() && res.status < 300) {
+        throw std::runtime_error("Connection closed while uploading to " + target);
+    }
+    return res;
+}
+
+dockerpack::http_response dockerpack::unix_http_client::read_response(unix_socket& sock, const std::string& method, const body_handler_t& handler) {
+    asio::streambuf buf;
+    const size_t headers_len = asio::read_until(sock, buf, "\r\n\r\n");
+    std::string head(asio::buffers_begin(buf.data()), asio::buffers_begin(buf.data()) + headers_len);
+    buf.consume(headers_len);
+
+    http_response res;
+    std::vector<std::string> lines = toolbox::strings::split(head, "\r\n");
+    if (lines.empty()) {
+        throw std::runtime_error("Invalid HTTP response from " + m_socket_path);
+    }
+    // HTTP/1.1 200 OK
+    std::stringstream status_line(lines[0]);
+    std::string proto;
+    status_line >> proto >> res.status;
+    for (size_t i = 1; i < lines.size(); i++) {
+        auto kv = toolbox::strings::split_pair(lines[i], ":");
+        if (kv.first.empty()) {
+            continue;
+        }
+        std::string value = kv.second;
+        toolbox::strings::trim_ref(value);
+        res.headers[toolbox::strings::to_lower_case(kv.first)] = std::move(value);
+    }
+
+    if (res.status == 204 || res.status == 304 || method == "HEAD") {
+        return res;
+    }
+
+    if (res.headers.count("transfer-encoding") && toolbox::strings::has_substring("chunked", res.headers.at("transfer-encoding"))) {
+        read_body_chunked(sock, buf, handler);
+    } else if (res.headers.count("content-length")) {
+        read_body_sized(sock, buf, std::stoul(res.headers.at("content-length")), handler);
+    } else {
+        // hijacked attach stream: raw data until connection close
+        read_body_until_eof(sock, buf, handler);
+    }
+
+    return res;
+}
+
+// stream demultiplexing
+
+dockerpack::stream_demuxer::stream_demuxer(line_handler_t handler)
+    : m_handler(std::move(handler)) {
+}
+
+void dockerpack::stream_demuxer::emit(bool is_stderr, const char* data, size_t size) {
+    std::string& line = is_stderr ? m_stderr_line : m_stdout_line;
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == '\n') {
+            m_handler(is_stderr, line);
+            line.clear();
+        } else {
+            line.push_back(data[i]);
+        }
+    }
+}
+
+void dockerpack::stream_demuxer::feed(const char* data, size_t size) {
+    size_t pos = 0;
+    while (pos < size) {
+        if (m_frame_left == 0) {
+            const size_t need = std::min(8 - m_header.size(), size - pos);
+            m_header.append(data + pos, need);
+            pos += need;
+            if (m_header.size() < 8) {
+                return;
+            }
+
+            const auto* h = reinterpret_cast<const unsigned char*>(m_header.data());
+            m_frame_stderr = h[0] == 2;
+            m_frame_left = ((size_t) h[4] << 24) | ((size_t) h[5] << 16) | ((size_t) h[6] << 8) | (size_t) h[7];
+            m_header.clear();
+            continue;
+        }
+
+        const size_t n = std::min(m_frame_left, size - pos);
+        emit(m_frame_stderr, data + pos, n);
+        pos += n;
+        m_frame_left -= n;
+    }
+}
+
+void dockerpack::stream_demuxer::finish() {
+    if (!m_stdout_line.empty()) {
+        m_handler(false, m_stdout_line);
+        m_stdout_line.clear();
+    }
+    if (!m_stderr_line.empty()) {
+        m_handler(true, m_stderr_line);
+        m_stderr_line.clear();
+    }
+}
+
+// backend
+
+static std::string error_message(const dockerpack::http_response& res) {
+    const auto body = nlohmann::json::parse(res.body, nullptr, false);
+    if (!body.is_discarded() && body.is_object() && body.count("message")) {
+        return body.at("message").get<std::string>();
+    }
+    return "HTTP " + std::to_string(res.status) + ": " + res.body;
+}
+
+static void ensure_success(const dockerpack::http_response& res, const std::string& action) {
+    if (res.status < 200 || res.status >= 300) {
+        // 304: container already started or stopped
+        if (res.status == 304) {
+            return;
+        }
+        throw std::runtime_error(action + ": " + error_message(res));
+    }
+}
+
+static nlohmann::json env_list(const dockerpack::env_map& envs) {
+    nlohmann::json out = nlohmann::json::array();
+    for (const auto& kv : envs) {
+        out.push_back(kv.first + "=" + kv.second);
+    }
+    return out;
+}
+
+dockerpack::api_backend::api_backend(std::string socket_path, bool debug)
+    : m_client(std::move(socket_path)),
+      m_debug(debug) {
+}
+
+dockerpack::http_response dockerpack::api_backend::call(const std::string& method, const std::string& path, const std::string& body) {
+    if (m_debug) {
+        dockerpack::output() << "[debug] api: " << style::green << method << " " << path << style::reset << std::endl;
+    }
+    return m_client.request(method, "/" + API_VERSION + path, body);
+}
+
+void dockerpack::api_backend::pull(const std::string& image) {
+    const auto repo_tag = split_image_reference(image);
+    const std::string& repo = repo_tag.first;
+    const std::string& tag = repo_tag.second;
+
+    const std::string path = "/images/create?fromImage=" + unix_http_client::url_encode(repo) + "&tag=" + unix_http_client::url_encode(tag);
+    if (m_debug) {
+        dockerpack::output() << "[debug] api: " << style::green << "POST " << path << style::reset << std::endl;
+    }
+
+    // progress is streamed as json lines, error is reported in the same stream
+    std::string pending;
+    std::string error;
+    const auto res = m_client.stream("POST", "/" + API_VERSION + path, "", [&pending, &error](const char* data, size_t size) {
+        pending.append(data, size);
+        size_t nl;
+        while ((nl = pending.find('\n')) != std::string::npos) {
+            const auto msg = nlohmann::json::parse(pending.substr(0, nl), nullptr, false);
+            pending.erase(0, nl + 1);
+            if (!msg.is_discarded() && msg.is_object() && msg.count("error")) {
+                error = msg.at("error").get<std::string>();
+            }
+        }
+    });
+
+    if (res.status != 200) {
+        throw std::runtime_error("Unable to pull image " + image + ": HTTP " + std::to_string(res.status) + " " + pending);
+    }
+    if (!error.empty()) {
+        throw std::runtime_error("Unable to pull image " + image + ": " + error);
+    }
+}
+
+std::string dockerpack::api_backend::run(const std::string& name, const std::string& image, const env_map& envs, const std::vector<volume_mount>& mounts) {
+    nlohmann::json create;
+    create["Image"] = image;
+    create["Env"] = env_list(envs);
+    create["Cmd"] = {"/bin/bash"};
+    create["Tty"] = true;
+    create["OpenStdin"] = true;
+    if (!mounts.empty()) {
+        nlohmann::json mount_list = nlohmann::json::array();
+        for (const auto& mount : mounts) {
+            mount_list.push_back({
+                {"Type", mount.bind ? "bind" : "volume"},
+                {"Source", mount.source},
+                {"Target", mount.target},
+                {"ReadOnly", mount.read_only},
+            });
+        }
+        create["HostConfig"]["Mounts"] = std::move(mount_list);
+    }
+
+    const std::string create_path = "/containers/create?name=" + unix_http_client::url_encode(name);
+    auto res = call("POST", create_path, create.dump());
+    if (res.status == 404) {
+        // docker run pulls missing image implicitly
+        pull(image);
+        res = call("POST", create_path, create.dump());
+    }
+    ensure_success(res, "Unable to create container " + name);
+
+    const std::string id = nlohmann::json::parse(res.body).at("Id").get<std::string>();
+    ensure_success(call("POST", "/containers/" + id + "/start"), "Unable to start container " + name);
+    return id;
+}
+
+int dockerpack::api_backend::exec_attached(const std::string& container, const exec_options& opts, const stream_demuxer::line_handler_t& handler) {
+    nlohmann::json create;
+    create["AttachStdout"] = true;
+    create["AttachStderr"] = true;
+    create["Tty"] = false;
+    create["Cmd"] = {"bash", "-c", opts.command};
+    if (!opts.envs.empty()) {
+        create["Env"] = env_list(opts.envs);
+    }
+    if (!opts.workdir.empty()) {
+        create["WorkingDir"] = opts.workdir;
+    }
+
+    const auto res = call("POST", "/containers/" + unix_http_client::url_encode(container) + "/exec", create.dump());
+    ensure_success(res, "Unable to create exec in " + container);
+    const std::string exec_id = nlohmann::json::parse(res.body).at("Id").get<std::string>();
+
+    nlohmann::json start;
+    start["Detach"] = false;
+    start["Tty"] = false;
+
+    stream_demuxer demuxer(handler);
+    const auto start_res = m_client.stream("POST", "/" + API_VERSION + "/exec/" + exec_id + "/start", start.dump(), [&demuxer](const char* data, size_t size) {
+        demuxer.feed(data, size);
+    });
+    demuxer.finish();
+    ensure_success(start_res, "Unable to start exec in " + container);
+
+    const auto inspect = call("GET", "/exec/" + exec_id + "/json");
+    ensure_success(inspect, "Unable to inspect exec in " + container);
+    const auto info = nlohmann::json::parse(inspect.body);
+    if (info.at("ExitCode").is_null()) {
+        return 0;
+    }
+    return info.at("ExitCode").get<int>();
+}
+
+int dockerpack::api_backend::exec(const std::string& container, const exec_options& opts) {
+    return exec_attached(container, opts, [&opts](bool is_stderr, const std::string& line) {
+        opts.emit(is_stderr, line);
+    });
+}
+
+std::string dockerpack::api_backend::exec_output(const std::string& container, const std::string& command) {
+    exec_options opts;
+    opts.command = command;
+
+    std::stringstream out;
+    std::stringstream err;
+    const int status = exec_attached(container, opts, [&out, &err](bool is_stderr, const std::string& line) {
+        (is_stderr ? err : out) << line << "\n";
+    });
+    if (status) {
+        throw std::runtime_error(err.str());
+    }
+    return out.str();
+}
+
+static std::string base64_decode(const std::string& value) {
+    static const std::string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    uint32_t acc = 0;
+    int bits = 0;
+    for (char c : value) {
+        // url-safe alphabet is accepted too, padding is skipped
+        if (c == '-') {
+            c = '+';
+        } else if (c == '_') {
+            c = '/';
+        }
+        const size_t pos = alphabet.find(c);
+        if (pos == std::string::npos) {
+            continue;
+        }
+        acc = (acc << 6) | (uint32_t) pos;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back((char) ((acc >> bits) & 0xFF));
+        }
+    }
+    return out;
+}
+
+bool dockerpack::api_backend::is_directory(const std::string& container, const std::string& path) {
+    // go os.ModeDir
+    static const uint64_t MODE_DIR = 1ULL << 31;
+
+    const auto res = call("HEAD", "/containers/" + unix_http_client::url_encode(container) + "/archive?path=" + unix_http_client::url_encode(path));
+    if (res.status == 404) {
+        return false;
+    }
+    ensure_success(res, "Unable to stat " + container + ":" + path);
+
+    const auto it = res.headers.find("x-docker-container-path-stat");
+    if (it == res.headers.end()) {
+        return false;
+    }
+    const auto stat = nlohmann::json::parse(base64_decode(it->second), nullptr, false);
+    return !stat.is_discarded() && stat.is_object() && (stat.value("mode", (uint64_t) 0) & MODE_DIR) != 0;
+}
+
+void dockerpack::api_backend::copy(const std::string& local_path, const std::string& container, const std::string& remote_path) {
+    file_entry entry;
+    if (!stat_entry(local_path, entry)) {
+        throw std::runtime_error("Unable to copy " + local_path + ": file not found");
+    }
+
+    // same as "docker cp": file is put into existing directory, otherwise it's written to the remote path itself
+    std::string dir = remote_path;
+    std::string name = boost::filesystem::path(local_path).filename().string();
+    if (!is_directory(container, remote_path)) {
+        const size_t slash = remote_path.find_last_of('/');
+        dir = slash == std::string::npos ? "." : remote_path.substr(0, std::max<size_t>(slash, 1));
+        name = remote_path.substr(slash == std::string::npos ? 0 : slash + 1);
+        if (name.empty()) {
+            throw std::runtime_error("Unable to copy to " + container + ":" + remote_path + ": directory does not exist");
+        }
+    }
+
+    copy_stream(container, dir, [&name, &entry, &local_path](std::ostream& os) {
+        tar_writer tar(os);
+        tar.add(name, entry, local_path);
+        tar.finish();
+    });
+}
+
+void dockerpack::api_backend::copy_stream(const std::string& container, const std::string& remote_path, const archive_writer_t& writer) {
+    const std::string target = "/" + API_VERSION + "/containers/" + unix_http_client::url_encode(container) + "/archive?path=" + unix_http_client::url_encode(remote_path);
+    if (m_debug) {
+        dockerpack::output() << "[debug] api: " << style::green << "PUT " << target << style::reset << std::endl;
+    }
+    ensure_success(m_client.upload("PUT", target, "application/x-tar", writer), "Unable to copy to " + container + ":" + remote_path);
+}
+
+void dockerpack::api_backend::stop(const std::string& container) {
+    ensure_success(call("POST", "/containers/" + unix_http_client::url_encode(container) + "/stop"), "Unable to stop " + container);
+}
+
+void dockerpack::api_backend::rm(const std::string& container) {
+    // same as cli: error is ignored
+    call("DELETE", "/containers/" + unix_http_client::url_encode(container));
+}
+
+std::vector<dockerpack::docker_image> dockerpack::api_backend::images() {
+    const auto res = call("GET", "/images/json");
+    std::vector<docker_image> out;
+    if (res.status != 200) {
+        return out;
+    }
+
+    const auto list = nlohmann::json::parse(res.body);
+    for (const auto& item : list) {
+        if (!item.count("RepoTags") || item.at("RepoTags").is_null()) {
+            continue;
+        }
+        const std::string id = short_image_id(item.value("Id", ""));
+        for (const auto& repo_tag : item.at("RepoTags")) {
+            const auto value = repo_tag.get<std::string>();
+            if (value == "<none>:<none>") {
+                continue;
+            }
+            auto parts = split_image_reference(value);
+            out.push_back(docker_image{std::move(parts.first), std::move(parts.second), id});
+        }
+    }
+    return out;
+}
+
+std::string dockerpack::api_backend::commit(const std::string& container, const std::string& repo, const std::string& tag) {
+    const std::string path = "/commit?container=" + unix_http_client::url_encode(container) + "&repo=" + unix_http_client::url_encode(repo) + "&tag=" + unix_http_client::url_encode(tag);
+    const auto res = call("POST", path);
+    ensure_success(res, "Unable to commit " + container);
+    return short_image_id(nlohmann::json::parse(res.body).value("Id", ""));
+}
+
+void dockerpack::api_backend::remove_image(const std::string& image) {
+    const auto res = call("DELETE", "/images/" + unix_http_client::url_encode(image));
+    ensure_success(res, "Unable to remove image " + image);
+}
+
+void dockerpack::api_backend::create_volume(const std::string& name, const std::unordered_map<std::string, std::string>& driver_opts) {
+    nlohmann::json create;
+    create["Name"] = name;
+    create["Driver"] = "local";
+    create["DriverOpts"] = nlohmann::json::object();
+    for (const auto& kv : driver_opts) {
+        create["DriverOpts"][kv.first] = kv.second;
+    }
+    ensure_success(call("POST", "/volumes/create", create.dump()), "Unable to create volume " + name);
+}
+
+void dockerpack::api_backend::remove_volume(const std::string& name) {
+    ensure_success(call("DELETE", "/volumes/" + unix_http_client::url_encode(name)), "Unable to remove volume " + name);
+}
+
+std::vector<dockerpack::container_info> dockerpack::api_backend::ps() {
+    const auto res = call("GET", "/containers/json?all=1");
+    ensure_success(res, "Unable to list containers");
+
+    std::vector<container_info> out;
+    const auto list = nlohmann::json::parse(res.body);
+    for (const auto& item : list) {
+        const std::string id = item.at("Id").get<std::string>();
+        for (const auto& name : item.at("Names")) {
+            std::string n = name.get<std::string>();
+            if (!n.empty() && n[0] == '/') {
+                n = n.substr(1);
+            }
+            out.push_back(container_info{id, std::move(n)});
+        }
+    }
+    return out;
+}
+
+void dockerpack::api_backend::watch_events(const event_handler_t& handler) {
+    const std::string filters = R"({"type":["container"],"event":["create","destroy"]})";
+    const std::string path = "/" + API_VERSION + "/events?filters=" + unix_http_client::url_encode(filters);
+
+    std::string pending;
+    try {
+        m_client.stream(
+            "GET", path, "", [&pending, &handler](const char* data, size_t size) {
+                pending.append(data, size);
+                size_t nl;
+                while ((nl = pending.find('\n')) != std::string::npos) {
+                    const auto msg = nlohmann::json::parse(pending.substr(0, nl), nullptr, false);
+                    pending.erase(0, nl + 1);
+                    if (msg.is_discarded() || !msg.is_object() || !msg.count("Actor")) {
+                        continue;
+                    }
+                    const auto& actor = msg.at("Actor");
+                    container_event event;
+                    event.action = msg.value("Action", "");
+                    event.container.id = actor.value("ID", "");
+                    if (actor.count("Attributes") && actor.at("Attributes").is_object()) {
+                        event.container.name = actor.at("Attributes").value("name", "");
+                    }
+                    handler(event);
+                }
+            },
+            &m_events_cancel);
+    } catch (const std::exception&) {
+        // connection is closed by stop_events()
+    }
+}
+
+void dockerpack::api_backend::stop_events() {
+    m_events_cancel.cancel();
+}
@@ -0,0 +1,131 @@
+/*!
+ * dockerpack.
+ * docker_api.h
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#ifndef DOCKERPACK_DOCKER_API_H
+#define DOCKERPACK_DOCKER_API_H
+
+#include "docker_backend.h"
+
+#include <boost/asio/local/stream_protocol.hpp>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+namespace dockerpack {
+
+struct http_response {
+    int status = 0;
+    std::unordered_map<std::string, std::string> headers;
+    std::string body;
+};
+
+/// \brief Interrupts long running unix_http_client::stream() from another thread
+class http_cancel_token {
+public:
+    void cancel();
+
+private:
+    friend class unix_http_client;
+    std::mutex m_lock;
+    int m_fd = -1;
+    bool m_cancelled = false;
+};
+
+/// \brief Minimal HTTP/1.1 client working over unix domain socket.
+/// Every request uses it's own connection, so the client can be used from different threads.
+class unix_http_client {
+public:
+    using body_handler_t = std::function<void(const char* data, size_t size)>;
+    using body_writer_t = std::function<void(std::ostream& os)>;
+
+    explicit unix_http_client(std::string socket_path);
+
+    http_response request(const std::string& method, const std::string& target, const std::string& body = "");
+    /// \brief Send request and pass response body to handler as soon as it's received.
+    /// Used for long responses (attached streams, image pull progress).
+    /// \return response with empty body
+    http_response stream(const std::string& method, const std::string& target, const std::string& body, const body_handler_t& handler, http_cancel_token* cancel = nullptr);
+
+    /// \brief Send request with body of unknown size produced by writer (chunked transfer encoding).
+    /// If daemon rejects request before the body is sent, it's response is returned.
+    /// \throws anything thrown by writer
+    http_response upload(const std::string& method, const std::string& target, const std::string& content_type, const body_writer_t& writer);
+
+    static std::string url_encode(const std::string& value);
+
+private:
+    http_response read_response(boost::asio::local::stream_protocol::socket& sock, const std::string& method, const body_handler_t& handler);
+
+    std::string m_socket_path;
+};
+
+/// \brief Splits docker multiplexed attach stream (8 byte frame header: stream type, 3 zero bytes, big endian size)
+/// into stdout and stderr lines.
+class stream_demuxer {
+public:
+    using line_handler_t = std::function<void(bool is_stderr, const std::string& line)>;
+
+    explicit stream_demuxer(line_handler_t handler);
+
+    void feed(const char* data, size_t size);
+    /// \brief Flush incomplete last lines
+    void finish();
+
+private:
+    void emit(bool is_stderr, const char* data, size_t size);
+
+    line_handler_t m_handler;
+    std::string m_header;
+    size_t m_frame_left = 0;
+    bool m_frame_stderr = false;
+    std::string m_stdout_line;
+    std::string m_stderr_line;
+};
+
+/// \brief Backend which talks to Docker Engine API directly over unix socket
+class api_backend : public docker_backend {
+public:
+    static const std::string API_VERSION;
+
+    explicit api_backend(std::string socket_path, bool debug = false);
+
+    std::string run(const std::string& name, const std::string& image, const env_map& envs, const std::vector<volume_mount>& mounts) override;
+    int exec(const std::string& container, const exec_options& opts) override;
+    std::string exec_output(const std::string& container, const std::string& command) override;
+    void copy(const std::string& local_path, const std::string& container, const std::string& remote_path) override;
+    void copy_stream(const std::string& container, const std::string& remote_path, const archive_writer_t& writer) override;
+    void stop(const std::string& container) override;
+    void rm(const std::string& container) override;
+    std::vector<docker_image> images() override;
+    void pull(const std::string& image) override;
+    std::string commit(const std::string& container, const std::string& repo, const std::string& tag) override;
+    void remove_image(const std::string& image) override;
+    void create_volume(const std::string& name, const std::unordered_map<std::string, std::string>& driver_opts) override;
+    void remove_volume(const std::string& name) override;
+    std::vector<container_info> ps() override;
+    void watch_events(const event_handler_t& handler) override;
+    void stop_events() override;
+
+private:
+    http_response call(const std::string& method, const std::string& path, const std::string& body = "");
+    /// \return exec exit code
+    int exec_attached(const std::string& container, const exec_options& opts, const stream_demuxer::line_handler_t& handler);
+
+    /// \brief Path exists in container and it's a directory
+    bool is_directory(const std::string& container, const std::string& path);
+
+    unix_http_client m_client;
+    bool m_debug;
+    http_cancel_token m_events_cancel;
+};
+
+} // namespace dockerpack
+
+#endif //DOCKERPACK_DOCKER_API_H
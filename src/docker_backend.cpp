@@ -0,0 +1,356 @@
+/*!
+ * dockerpack.
+ * docker_backend.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "docker_backend.h"
+
+#include "docker_api.h"
+#include "execmd.h"
+#include "output.h"
+
+#include <boost/filesystem.hpp>
+#include <termcolor/termcolor.hpp>
+#include <thread>
+#include <toolbox/strings.hpp>
+
+namespace style = termcolor;
+
+static std::string run_checked(const std::string& command) {
+    int status = 0;
+    dockerpack::execmd cmd(command);
+    std::string res = cmd.run(&status);
+    if (status) {
+        throw std::runtime_error(res);
+    }
+    return res;
+}
+
+bool dockerpack::cli_backend::available() {
+    return !bp::search_path("docker").empty();
+}
+
+dockerpack::cli_backend::cli_backend(bool debug)
+    : m_debug(debug) {
+}
+
+void dockerpack::exec_options::emit(bool is_stderr, const std::string& line) const {
+    if (log != nullptr) {
+        log->write(line);
+    }
+    if (output || is_stderr) {
+        dockerpack::output(prefix, is_stderr ? std::cerr : std::cout) << line << std::endl;
+    }
+}
+
+std::string dockerpack::cli_backend::run(const std::string& name, const std::string& image, const env_map& envs, const std::vector<volume_mount>& mounts) {
+    std::stringstream env_builder;
+    for (const auto& entry : envs) {
+        env_builder << "-e " << entry.first << "=" << entry.second << " ";
+    }
+    for (const auto& mount : mounts) {
+        env_builder << "--mount \"type=" << (mount.bind ? "bind" : "volume") << ",source=" << mount.source << ",target=" << mount.target;
+        if (mount.read_only) {
+            env_builder << ",readonly";
+        }
+        env_builder << "\" ";
+    }
+
+    std::stringstream cmd_builder;
+    cmd_builder << "docker run " << env_builder.str();
+    cmd_builder << "-d -it --name ";
+    cmd_builder << name << " " << image << " ";
+    cmd_builder << "/bin/bash";
+
+    if (m_debug) {
+        dockerpack::output() << "[debug] run: " << style::green << cmd_builder.str() << style::reset << std::endl;
+    }
+
+    const std::string res = run_checked(cmd_builder.str());
+    return toolbox::strings::substr_replace_all_ret({"\n", "\t", "\r"}, {"", "", ""}, res);
+}
+
+int dockerpack::cli_backend::exec(const std::string& container, const exec_options& opts) {
+    std::stringstream cmd_builder;
+    cmd_builder << "docker exec ";
+    if (!opts.workdir.empty()) {
+        cmd_builder << "-w " << opts.workdir << " ";
+    }
+    for (const auto& kv : opts.envs) {
+        cmd_builder << "-e " << kv.first << "=" << kv.second << " ";
+    }
+
+    cmd_builder << container << " ";
+    cmd_builder << "bash -c \"";
+    cmd_builder << opts.command;
+    cmd_builder << "\"";
+
+    if (m_debug) {
+        dockerpack::output(opts.prefix) << "[debug] exec: " << style::green << cmd_builder.str() << style::reset << std::endl;
+    }
+
+    dockerpack::exec_stream cmd(cmd_builder.str());
+    cmd.run(opts.output, opts.prefix, opts.log);
+    const int status = cmd.wait();
+    if (status) {
+        const auto ec = cmd.error_code();
+        if (ec) {
+            throw std::runtime_error(ec.message());
+        }
+    }
+    return status;
+}
+
+std::string dockerpack::cli_backend::exec_output(const std::string& container, const std::string& command) {
+    std::stringstream cmd_builder;
+    cmd_builder << "docker exec ";
+    cmd_builder << container << " ";
+    cmd_builder << "bash -c \"";
+    cmd_builder << command;
+    cmd_builder << "\"";
+
+    return run_checked(cmd_builder.str());
+}
+
+void dockerpack::cli_backend::copy(const std::string& local_path, const std::string& container, const std::string& remote_path) {
+    const std::string command = "docker cp " + local_path + " " + container + ":" + remote_path;
+    if (m_debug) {
+        dockerpack::output() << "[debug] copy: " << command << std::endl;
+    }
+    run_checked(command);
+}
+
+void dockerpack::cli_backend::copy_stream(const std::string& container, const std::string& remote_path, const archive_writer_t& writer) {
+    const std::string command = "docker cp - " + container + ":" + remote_path;
+    if (m_debug) {
+        dockerpack::output() << "[debug] copy: " << command << std::endl;
+    }
+
+    bp::opstream in;
+    bp::ipstream err;
+    bp::child child(command, bp::std_in < in, bp::std_out > bp::null, bp::std_err > err, dockerpack::std_only_fds());
+    // docker could fail before reading whole stdin, so stderr is read concurrently
+    std::string message;
+    std::thread err_reader([&err, &message]() {
+        std::string line;
+        while (std::getline(err, line)) {
+            message += line + "\n";
+        }
+    });
+
+    std::exception_ptr write_error;
+    bool pipe_closed = false;
+    try {
+        in.exceptions(std::ios::badbit);
+        writer(in);
+        in.flush();
+    } catch (const std::ios_base::failure&) {
+        // docker exited, it's message explains why
+        pipe_closed = true;
+    } catch (...) {
+        write_error = std::current_exception();
+    }
+    in.pipe().close();
+    child.wait();
+    err_reader.join();
+
+    // truncated archive makes docker fail too, so writer error goes first
+    if (write_error) {
+        std::rethrow_exception(write_error);
+    }
+    if (child.exit_code() || pipe_closed) {
+        throw std::runtime_error(message.empty() ? "Unable to copy to " + container + ":" + remote_path : message);
+    }
+}
+
+void dockerpack::cli_backend::stop(const std::string& container) {
+    if (m_debug) {
+        dockerpack::output() << "[debug] stop: " << style::green << "docker stop " << container << style::reset << std::endl;
+    }
+    run_checked("docker stop " + container);
+}
+
+void dockerpack::cli_backend::rm(const std::string& container) {
+    if (m_debug) {
+        dockerpack::output() << "[debug] rm: " << style::green << "docker rm " << container << style::reset << std::endl;
+    }
+    dockerpack::execmd cmd("docker rm " + container);
+    int status = 0;
+    cmd.run(&status);
+}
+
+void dockerpack::cli_backend::pull(const std::string& image) {
+    if (m_debug) {
+        dockerpack::output() << "[debug] pull: " << style::green << "docker pull -q " << image << style::reset << std::endl;
+    }
+    // progress is not printed, error is written to stderr by docker itself
+    int status = 0;
+    dockerpack::execmd cmd("docker pull -q " + image);
+    cmd.run(&status);
+    if (status) {
+        throw std::runtime_error("Unable to pull image " + image);
+    }
+}
+
+std::vector<dockerpack::docker_image> dockerpack::cli_backend::images() {
+    dockerpack::execmd cmd("docker images --no-trunc --format \"{{.Repository}}:{{.Tag}}|{{.ID}}\"");
+    int status = 0;
+    const std::string result = cmd.run(&status);
+    if (status || result.empty()) {
+        return std::vector<dockerpack::docker_image>(0);
+    }
+
+    std::vector<std::string> lines = toolbox::strings::split(result, "\n");
+    std::vector<dockerpack::docker_image> out;
+    out.reserve(lines.size());
+    for (const std::string& line : lines) {
+        const size_t id_pos = line.rfind('|');
+        if (id_pos == std::string::npos) {
+            continue;
+        }
+        const std::string reference = line.substr(0, id_pos);
+        if (reference == "<none>:<none>") {
+            continue;
+        }
+        auto repo_tag = split_image_reference(reference);
+        out.push_back(dockerpack::docker_image{
+            std::move(repo_tag.first),
+            std::move(repo_tag.second),
+            short_image_id(line.substr(id_pos + 1))});
+    }
+    return out;
+}
+
+std::string dockerpack::cli_backend::commit(const std::string& container, const std::string& repo, const std::string& tag) {
+    std::stringstream ss;
+    ss << "docker commit ";
+    ss << container << " ";
+    ss << repo << ":" << tag;
+    // prints new image id: sha256:...
+    return short_image_id(toolbox::strings::trim(run_checked(ss.str())));
+}
+
+void dockerpack::cli_backend::remove_image(const std::string& image) {
+    if (m_debug) {
+        dockerpack::output() << "[debug] rmi: " << style::green << "docker rmi " << image << style::reset << std::endl;
+    }
+    run_checked("docker rmi " + image);
+}
+
+void dockerpack::cli_backend::create_volume(const std::string& name, const std::unordered_map<std::string, std::string>& driver_opts) {
+    std::stringstream cmd_builder;
+    cmd_builder << "docker volume create --driver local ";
+    for (const auto& kv : driver_opts) {
+        cmd_builder << "--opt \"" << kv.first << "=" << kv.second << "\" ";
+    }
+    cmd_builder << name;
+    if (m_debug) {
+        dockerpack::output() << "[debug] volume: " << style::green << cmd_builder.str() << style::reset << std::endl;
+    }
+    run_checked(cmd_builder.str());
+}
+
+void dockerpack::cli_backend::remove_volume(const std::string& name) {
+    if (m_debug) {
+        dockerpack::output() << "[debug] volume: " << style::green << "docker volume rm " << name << style::reset << std::endl;
+    }
+    run_checked("docker volume rm " + name);
+}
+
+std::vector<dockerpack::container_info> dockerpack::cli_backend::ps() {
+    const std::string res = run_checked("docker ps -a --format \"{{.ID}}|{{.Names}}\"");
+    std::vector<container_info> out;
+    if (res.empty()) {
+        return out;
+    }
+
+    std::vector<std::string> lines = toolbox::strings::split(res, "\n");
+    for (const auto& line : lines) {
+        if (line.empty()) {
+            continue;
+        }
+        std::vector<std::string> items = toolbox::strings::split(line, "|");
+        if (items.size() != 2) {
+            throw std::runtime_error("Undefined \"docker ps\" result: " + res);
+        }
+        out.push_back(container_info{items[0], items[1]});
+    }
+    return out;
+}
+
+void dockerpack::cli_backend::watch_events(const event_handler_t& handler) {
+    bp::ipstream out;
+    {
+        std::lock_guard<std::mutex> lock(m_events_lock);
+        if (m_events_stopped) {
+            return;
+        }
+        m_events = bp::child(
+            "docker events --filter type=container --filter event=create --filter event=destroy --format \"{{.Action}}|{{.Actor.ID}}|{{.Actor.Attributes.name}}\"",
+            bp::std_out > out,
+            bp::std_err > bp::null,
+            dockerpack::std_only_fds());
+    }
+
+    std::string line;
+    while (std::getline(out, line)) {
+        std::vector<std::string> items = toolbox::strings::split(line, "|");
+        if (items.size() != 3) {
+            continue;
+        }
+        handler(container_event{items[0], container_info{items[1], items[2]}});
+    }
+
+    std::error_code ec;
+    m_events.wait(ec);
+}
+
+void dockerpack::cli_backend::stop_events() {
+    std::lock_guard<std::mutex> lock(m_events_lock);
+    m_events_stopped = true;
+    std::error_code ec;
+    if (m_events.valid() && m_events.running(ec)) {
+        m_events.terminate(ec);
+    }
+}
+
+std::string dockerpack::short_image_id(const std::string& id) {
+    std::string out = id;
+    if (toolbox::strings::has_substring("sha256:", out)) {
+        out = out.substr(out.find("sha256:") + 7);
+    }
+    return out.substr(0, 12);
+}
+
+std::pair<std::string, std::string> dockerpack::split_image_reference(const std::string& reference) {
+    const size_t name_pos = reference.rfind('/');
+    const size_t tag_pos = reference.rfind(':');
+    if (tag_pos == std::string::npos || (name_pos != std::string::npos && tag_pos < name_pos)) {
+        return {reference, "latest"};
+    }
+    return {reference.substr(0, tag_pos), reference.substr(tag_pos + 1)};
+}
+
+std::unique_ptr<dockerpack::docker_backend> dockerpack::make_backend(const dockerpack::config& config) {
+    if (config.backend == "api") {
+        // backend can be set by argument too, so it's checked here and not only by config
+        if (config.session) {
+            throw std::runtime_error("Session is not supported by api backend: it runs shell with docker command line client. Use cli backend or disable session");
+        }
+        if (boost::filesystem::exists(config.docker_host)) {
+            return std::make_unique<dockerpack::api_backend>(config.docker_host, config.debug);
+        }
+        dockerpack::output(std::string(), std::cerr)
+            << style::yellow << "Docker engine socket " << config.docker_host << " not found, using docker command line client" << style::reset << std::endl;
+    } else if (config.backend != "cli") {
+        throw std::runtime_error("Unknown docker backend \"" + config.backend + "\". Available: cli, api");
+    }
+
+    if (!dockerpack::cli_backend::available()) {
+        throw std::runtime_error("'docker' binary not found on your system. Please install it first or add to $PATH.");
+    }
+    return std::make_unique<dockerpack::cli_backend>(config.debug);
+}
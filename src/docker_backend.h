@@ -0,0 +1,150 @@
+/*!
+ * dockerpack.
+ * docker_backend.h
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#ifndef DOCKERPACK_DOCKER_BACKEND_H
+#define DOCKERPACK_DOCKER_BACKEND_H
+
+#include "config.h"
+#include "data.h"
+#include "execmd.h"
+#include "output.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dockerpack {
+
+struct container_info {
+    std::string id;
+    std::string name;
+};
+
+struct container_event {
+    // create, destroy, etc
+    std::string action;
+    container_info container;
+};
+
+struct volume_mount {
+    // host path for bind mount, volume name otherwise
+    std::string source;
+    // absolute path inside container
+    std::string target;
+    bool bind = true;
+    bool read_only = false;
+};
+
+struct exec_options {
+    std::string command;
+    std::string workdir;
+    env_map envs;
+    // print command output
+    bool output = true;
+    // output line prefix
+    std::string prefix;
+    // every output line is written to this log if set
+    log_file* log = nullptr;
+
+    /// \brief Write output line to log and print it if it's enabled. Without output only stderr is printed
+    void emit(bool is_stderr, const std::string& line) const;
+};
+
+/// \brief Low level docker operations. Containers are addressed by name or id.
+/// Every method throws std::runtime_error if docker reports an error.
+class docker_backend {
+public:
+    using event_handler_t = std::function<void(const container_event& event)>;
+    using archive_writer_t = std::function<void(std::ostream& os)>;
+
+    virtual ~docker_backend() = default;
+
+    /// \brief Create and start detached container with interactive bash
+    /// \return container id
+    virtual std::string run(const std::string& name, const std::string& image, const env_map& envs, const std::vector<volume_mount>& mounts) = 0;
+    /// \brief Execute bash command inside container
+    /// \return command exit code
+    virtual int exec(const std::string& container, const exec_options& opts) = 0;
+    /// \brief Execute bash command inside container and return it's stdout
+    virtual std::string exec_output(const std::string& container, const std::string& command) = 0;
+    /// \brief Copy local file or directory to container
+    virtual void copy(const std::string& local_path, const std::string& container, const std::string& remote_path) = 0;
+    /// \brief Extract tar stream produced by writer to existing container directory. Archive is not stored on disk.
+    /// \throws anything thrown by writer
+    virtual void copy_stream(const std::string& container, const std::string& remote_path, const archive_writer_t& writer) = 0;
+    virtual void stop(const std::string& container) = 0;
+    virtual void rm(const std::string& container) = 0;
+    virtual std::vector<docker_image> images() = 0;
+    /// \brief Pull image from registry
+    virtual void pull(const std::string& image) = 0;
+    /// \return short id of created image
+    virtual std::string commit(const std::string& container, const std::string& repo, const std::string& tag) = 0;
+    /// \brief Remove local image by reference or id
+    virtual void remove_image(const std::string& image) = 0;
+    /// \brief Create named volume of "local" driver
+    /// \param driver_opts mount options: type, device, o
+    virtual void create_volume(const std::string& name, const std::unordered_map<std::string, std::string>& driver_opts) = 0;
+    virtual void remove_volume(const std::string& name) = 0;
+    /// \brief All containers, including stopped
+    virtual std::vector<container_info> ps() = 0;
+    /// \brief Blocks and reports container create and destroy events until stop_events() is called
+    virtual void watch_events(const event_handler_t& handler) = 0;
+    /// \brief Unblocks watch_events(), can be called from any thread
+    virtual void stop_events() = 0;
+};
+
+/// \brief Backend which spawns "docker" command line client for every operation
+class cli_backend : public docker_backend {
+public:
+    /// \brief Check "docker" binary exists in $PATH
+    static bool available();
+
+    explicit cli_backend(bool debug = false);
+
+    std::string run(const std::string& name, const std::string& image, const env_map& envs, const std::vector<volume_mount>& mounts) override;
+    int exec(const std::string& container, const exec_options& opts) override;
+    std::string exec_output(const std::string& container, const std::string& command) override;
+    void copy(const std::string& local_path, const std::string& container, const std::string& remote_path) override;
+    void copy_stream(const std::string& container, const std::string& remote_path, const archive_writer_t& writer) override;
+    void stop(const std::string& container) override;
+    void rm(const std::string& container) override;
+    std::vector<docker_image> images() override;
+    void pull(const std::string& image) override;
+    std::string commit(const std::string& container, const std::string& repo, const std::string& tag) override;
+    void remove_image(const std::string& image) override;
+    void create_volume(const std::string& name, const std::unordered_map<std::string, std::string>& driver_opts) override;
+    void remove_volume(const std::string& name) override;
+    std::vector<container_info> ps() override;
+    void watch_events(const event_handler_t& handler) override;
+    void stop_events() override;
+
+private:
+    bool m_debug;
+    std::mutex m_events_lock;
+    bp::child m_events;
+    bool m_events_stopped = false;
+};
+
+/// \brief Short (12 chars) image id from any form: full, prefixed with "sha256:" or already short one
+std::string short_image_id(const std::string& id);
+
+/// \brief Split image reference to repository and tag. Registry host may include port: "localhost:5000/repo:tag".
+/// If reference has no tag, "latest" is returned.
+std::pair<std::string, std::string> split_image_reference(const std::string& reference);
+
+/// \brief Creates backend selected in config ("cli" or "api").
+/// If docker engine socket is not available, falls back to command line client.
+std::unique_ptr<docker_backend> make_backend(const dockerpack::config& config);
+
+} // namespace dockerpack
+
+#endif //DOCKERPACK_DOCKER_BACKEND_H
@@ -8,6 +8,43 @@
  */
 #include "execmd.h"
 
+#include "output.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/wait.h>
+#include <unordered_set>
+
+// streams with started and not waited child process
+static std::mutex running_lock;
+static std::unordered_set<dockerpack::exec_stream*> running_streams;
+
+void dockerpack::close_inherited_fds() {
+#if defined(CLOSE_RANGE_CLOEXEC)
+    if (::close_range(3, ~0U, CLOSE_RANGE_CLOEXEC) == 0) {
+        return;
+    }
+#endif
+    // old kernel: only open descriptors are listed, as limit of them can be huge
+    DIR* dir = ::opendir("/dev/fd");
+    if (dir == nullptr) {
+        return;
+    }
+    const int dir_fd = ::dirfd(dir);
+    struct dirent* ent;
+    while ((ent = ::readdir(dir)) != nullptr) {
+        const int fd = std::atoi(ent->d_name);
+        if (fd > STDERR_FILENO && fd != dir_fd) {
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+    ::closedir(dir);
+}
+
 dockerpack::execmd::execmd(std::string cmd)
     : cmd(std::move(cmd)) {
 }
@@ -15,7 +52,7 @@ dockerpack::execmd::execmd(std::string cmd)
 std::string dockerpack::execmd::run(int* exit_code) const {
     try {
         bp::ipstream s;
-        bp::child runner(cmd, bp::std_out > s);
+        bp::child runner(cmd, bp::std_out > s, std_only_fds());
 
         std::stringstream ss;
         std::string line;
@@ -39,12 +76,45 @@ std::string dockerpack::execmd::run(int* exit_code) const {
 dockerpack::exec_stream::exec_stream(std::string cmd)
     : cmd(std::move(cmd)) {
 }
-void dockerpack::exec_stream::run(bool output) {
-    if (output) {
-        m_child = bp::child(cmd, bp::std_out > stdout, bp::std_err > stderr);
+dockerpack::exec_stream::~exec_stream() {
+    {
+        std::lock_guard<std::mutex> lock(running_lock);
+        running_streams.erase(this);
+    }
+    if (m_stdout_printer.joinable()) {
+        m_stdout_printer.join();
+    }
+    if (m_stderr_printer.joinable()) {
+        m_stderr_printer.join();
+    }
+}
+
+static void print_lines(bp::ipstream& stream, const std::string& prefix, std::ostream* os, dockerpack::log_file* log) {
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (log != nullptr) {
+            log->write(line);
+        }
+        if (os != nullptr) {
+            dockerpack::output(prefix, *os) << line << std::endl;
+        }
+    }
+}
+
+void dockerpack::exec_stream::run(bool output, const std::string& prefix, log_file* log) {
+    if (log != nullptr || (output && !prefix.empty())) {
+        // without output only stderr is printed
+        m_child = bp::child(cmd, bp::std_out > m_stdout_stream, bp::std_err > m_stderr_stream, std_only_fds());
+        m_stdout_printer = std::thread(print_lines, std::ref(m_stdout_stream), prefix, output ? &std::cout : nullptr, log);
+        m_stderr_printer = std::thread(print_lines, std::ref(m_stderr_stream), prefix, &std::cerr, log);
+    } else if (output) {
+        m_child = bp::child(cmd, bp::std_out > stdout, bp::std_err > stderr, std_only_fds());
     } else {
-        m_child = bp::child(cmd, bp::std_out > bp::null);
+        m_child = bp::child(cmd, bp::std_out > bp::null, std_only_fds());
     }
+
+    std::lock_guard<std::mutex> lock(running_lock);
+    running_streams.insert(this);
 }
 int dockerpack::exec_stream::exit_code() const {
     return 0;
@@ -53,20 +123,35 @@ std::error_code dockerpack::exec_stream::error_code() const {
     return m_err_code;
 }
 int dockerpack::exec_stream::wait() {
-    if (m_stdout_printer != nullptr) {
-        if (m_stdout_printer->joinable()) {
-            m_stdout_printer->join();
-        }
+    if (m_stdout_printer.joinable()) {
+        m_stdout_printer.join();
+    }
+    if (m_stderr_printer.joinable()) {
+        m_stderr_printer.join();
     }
-    if (m_stderr_printer != nullptr) {
-        if (m_stderr_printer->joinable()) {
-            m_stderr_printer->join();
+    if (m_child.valid()) {
+        // wait for exit without reaping: until stream is unregistered pid can't be reused, so terminate_all()
+        // never signals another process
+        siginfo_t info{};
+        while (::waitid(P_PID, (id_t) m_child.id(), &info, WEXITED | WNOWAIT) == -1 && errno == EINTR) {
         }
     }
-    if (m_child.running()) {
+    {
+        std::lock_guard<std::mutex> lock(running_lock);
+        running_streams.erase(this);
+    }
+    if (m_child.running(m_err_code)) {
         m_child.wait(m_err_code);
     }
     m_exit_code = m_child.exit_code();
 
     return m_exit_code;
 }
+
+void dockerpack::exec_stream::terminate_all() {
+    std::lock_guard<std::mutex> lock(running_lock);
+    for (auto* stream : running_streams) {
+        // not bp::child::terminate(): it waits for process, which is done by wait() in another thread
+        ::kill(stream->m_child.id(), SIGTERM);
+    }
+}
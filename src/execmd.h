@@ -10,6 +10,7 @@
 #define DOCKERPACK_EXECMD_H
 
 #include <boost/process.hpp>
+#include <boost/process/extend.hpp>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -20,6 +21,20 @@
 namespace bp = boost::process;
 
 namespace dockerpack {
+class log_file;
+
+/// \brief Mark all descriptors except std ones close-on-exec, called by child after fork
+void close_inherited_fds();
+
+/// \brief Child process property: child gets only it's own std streams. Otherwise it inherits pipes of commands
+/// started by other threads at the same time and keeps them open, so "docker cp -" never sees end of it's input
+struct std_only_fds : bp::extend::handler {
+    template<typename Executor>
+    void on_exec_setup(Executor&) const {
+        close_inherited_fds();
+    }
+};
+
 class execmd {
 public:
     explicit execmd(std::string cmd);
@@ -32,16 +47,24 @@ private:
 class exec_stream {
 public:
     explicit exec_stream(std::string cmd);
-    void run(bool output = true);
+    ~exec_stream();
+    /// \param output print command stdout and stderr
+    /// \param prefix if not empty, every output line is prefixed with it and written line by line
+    /// \param log if set, every output line is written to it
+    void run(bool output = true, const std::string& prefix = "", log_file* log = nullptr);
     int exit_code() const;
     std::error_code error_code() const;
     int wait();
 
+    /// \brief Send SIGTERM to all running commands, used to cancel in-flight jobs.
+    /// Commands started after this call are not affected.
+    static void terminate_all();
+
 private:
     int m_exit_code = 0;
     std::string cmd;
-    std::thread* m_stdout_printer = nullptr;
-    std::thread* m_stderr_printer = nullptr;
+    std::thread m_stdout_printer;
+    std::thread m_stderr_printer;
     bp::child m_child;
     bp::ipstream m_stdout_stream;
     bp::ipstream m_stderr_stream;
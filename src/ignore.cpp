@@ -0,0 +1,184 @@
+/*!
+ * dockerpack.
+ * ignore.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "ignore.h"
+
+#include <fstream>
+
+const std::string dockerpack::IGNORE_FILE = ".dockerpackignore";
+
+/// \return position after character class or npos if class is not closed
+static size_t match_class(const std::string& p, size_t pi, char c, bool& matched) {
+    // pi points to "["
+    size_t i = pi + 1;
+    bool negate = false;
+    if (i < p.size() && (p[i] == '!' || p[i] == '^')) {
+        negate = true;
+        i++;
+    }
+    bool found = false;
+    bool first = true;
+    while (i < p.size() && (p[i] != ']' || first)) {
+        char lo = p[i];
+        if (lo == '\\' && i + 1 < p.size()) {
+            lo = p[++i];
+        }
+        char hi = lo;
+        if (i + 2 < p.size() && p[i + 1] == '-' && p[i + 2] != ']') {
+            hi = p[i + 2];
+            i += 2;
+        }
+        if (c >= lo && c <= hi) {
+            found = true;
+        }
+        first = false;
+        i++;
+    }
+    if (i >= p.size()) {
+        return std::string::npos;
+    }
+    matched = found != negate;
+    return i + 1;
+}
+
+static bool glob_match_at(const std::string& p, size_t pi, const std::string& s, size_t si) {
+    while (pi < p.size()) {
+        if (p[pi] == '*' && pi + 1 < p.size() && p[pi + 1] == '*') {
+            pi += 2;
+            // "**/" also matches zero directories
+            const bool dirs = pi < p.size() && p[pi] == '/';
+            if (dirs) {
+                pi++;
+            }
+            for (size_t t = si;; t++) {
+                if ((!dirs || t == si || s[t - 1] == '/') && glob_match_at(p, pi, s, t)) {
+                    return true;
+                }
+                if (t >= s.size()) {
+                    return false;
+                }
+            }
+        }
+        if (p[pi] == '*') {
+            pi++;
+            for (size_t t = si;; t++) {
+                if (glob_match_at(p, pi, s, t)) {
+                    return true;
+                }
+                if (t >= s.size() || s[t] == '/') {
+                    return false;
+                }
+            }
+        }
+        if (si >= s.size()) {
+            return false;
+        }
+        if (p[pi] == '?') {
+            if (s[si] == '/') {
+                return false;
+            }
+            pi++;
+            si++;
+            continue;
+        }
+        if (p[pi] == '[') {
+            bool matched = false;
+            const size_t next = match_class(p, pi, s[si], matched);
+            if (next != std::string::npos) {
+                if (!matched || s[si] == '/') {
+                    return false;
+                }
+                pi = next;
+                si++;
+                continue;
+            }
+            // not closed class is a regular character
+        }
+        if (p[pi] == '\\' && pi + 1 < p.size()) {
+            pi++;
+        }
+        if (p[pi] != s[si]) {
+            return false;
+        }
+        pi++;
+        si++;
+    }
+    return si == s.size();
+}
+
+bool dockerpack::glob_match(const std::string& pattern, const std::string& path) {
+    return glob_match_at(pattern, 0, path, 0);
+}
+
+void dockerpack::ignore_rules::add(const std::string& pattern) {
+    std::string p = pattern;
+    // trailing spaces are ignored unless escaped
+    while (!p.empty() && p.back() == ' ' && (p.size() < 2 || p[p.size() - 2] != '\\')) {
+        p.pop_back();
+    }
+    if (p.empty() || p[0] == '#') {
+        return;
+    }
+
+    rule r;
+    if (p[0] == '!') {
+        r.negate = true;
+        p = p.substr(1);
+    } else if (p[0] == '\\') {
+        p = p.substr(1);
+    }
+    if (!p.empty() && p.back() == '/') {
+        r.dir_only = true;
+        p.pop_back();
+    }
+    if (p.empty()) {
+        return;
+    }
+
+    // pattern with separator is relative to the root, otherwise it matches name at any depth
+    if (p.find('/') != std::string::npos) {
+        if (p[0] == '/') {
+            p = p.substr(1);
+        }
+    } else {
+        p = "**/" + p;
+    }
+    r.pattern = std::move(p);
+    m_rules.push_back(std::move(r));
+}
+
+void dockerpack::ignore_rules::load(const std::string& path) {
+    std::ifstream is(path);
+    if (!is.is_open()) {
+        return;
+    }
+    std::string line;
+    while (std::getline(is, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        add(line);
+    }
+}
+
+bool dockerpack::ignore_rules::ignored(const std::string& rel_path, bool is_dir) const {
+    bool out = false;
+    for (const auto& r : m_rules) {
+        if (r.dir_only && !is_dir) {
+            continue;
+        }
+        if (out != !r.negate && glob_match(r.pattern, rel_path)) {
+            out = !r.negate;
+        }
+    }
+    return out;
+}
+
+bool dockerpack::ignore_rules::empty() const {
+    return m_rules.empty();
+}
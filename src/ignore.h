@@ -0,0 +1,45 @@
+/*!
+ * dockerpack.
+ * ignore.h
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#ifndef DOCKERPACK_IGNORE_H
+#define DOCKERPACK_IGNORE_H
+
+#include <string>
+#include <vector>
+
+namespace dockerpack {
+
+const extern std::string IGNORE_FILE;
+
+/// \brief Match path with gitignore-like glob: "*" and "?" don't match "/", "**" matches any number of directories
+bool glob_match(const std::string& pattern, const std::string& path);
+
+/// \brief Set of gitignore-like patterns. The last matching pattern wins, "!pattern" includes path back,
+/// "pattern/" matches only directories, pattern without "/" matches name at any depth.
+class ignore_rules {
+public:
+    void add(const std::string& pattern);
+    /// \brief Add patterns from file, one per line. Missing file is not an error
+    void load(const std::string& path);
+    /// \param rel_path path relative to copied directory, "/" separated
+    bool ignored(const std::string& rel_path, bool is_dir) const;
+    bool empty() const;
+
+private:
+    struct rule {
+        std::string pattern;
+        bool negate = false;
+        bool dir_only = false;
+    };
+
+    std::vector<rule> m_rules;
+};
+
+} // namespace dockerpack
+
+#endif //DOCKERPACK_IGNORE_H
@@ -1,6 +1,7 @@
 #include "builder.h"
 #include "config.h"
 #include "execmd.h"
+#include "trace.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
@@ -68,6 +69,8 @@ int main(int argc, char** argv) {
     desc.add_options()("help,h", "Print this help");
     desc.add_options()("version,v", "Print version");
     desc.add_options()("config,c", po::value<std::string>(), "Path to config file (by default, it looking for dockerpack.yml in current directory)");
+    desc.add_options()("no-config-cache", "Always parse config files, don't use parsed config cached by previous run");
+    desc.add_options()("backend", po::value<std::string>(), "Docker backend: cli - run docker command line client (default), api - talk to docker engine socket directly ($DOCKER_HOST or /var/run/docker.sock)");
 
     if (argc == 1) {
         std::cout << desc << std::endl;
@@ -88,6 +91,14 @@ int main(int argc, char** argv) {
         desc.add_options()("stateless", "Build jobs and don't save build state.");
         desc.add_options()("no-cleanup", "Don't stop and don't remove running container after success build");
         desc.add_options()("copy-local", "Copy all files from $PWD to image workdir");
+        desc.add_options()("jobs,j", po::value<size_t>()->default_value(1), "Run up to N jobs at the same time, each in it's own container. Output lines are prefixed with [job name]");
+        desc.add_options()("fail-fast", "Cancel running jobs as soon as one job fails. By default running jobs are finished, but new ones are not started");
+        desc.add_options()("keep-going", "Don't stop on failed job: run all other jobs and report every failure at the end");
+        desc.add_options()("warm", po::value<size_t>()->default_value(0), "Start containers of N next jobs and copy sources into them in background while current jobs run");
+        desc.add_options()("pull-jobs", po::value<size_t>()->default_value(4), "Pull up to N missing images at the same time before build starts, 0 - pull every image when it's job starts");
+        desc.add_options()("session", "Execute all steps of a job in one persistent shell instead of separate \"docker exec\" per step");
+        desc.add_options()("sync", "Copy only files changed since previous copy to the same container");
+        desc.add_options()("trace", po::value<std::string>(), "Write build timeline to file in Chrome trace format (open in ui.perfetto.dev or chrome://tracing)");
         desc.add_options()("env,e", po::value<std::vector<std::string>>(), "Pass build-time environment variables (-e A=1 -e B=2)");
         break;
 
@@ -95,6 +106,11 @@ int main(int argc, char** argv) {
         desc.add_options()("name,n", po::value<std::string>(), "Filter job or image to build. For multijob input 'repo:tag'. Filter is based on find substring in job name or job image.");
         desc.add_options()("reset", "Reset dockerpack.lock file and start build from begin");
         desc.add_options()("stateless", "Build jobs and don't save build state.");
+        desc.add_options()("jobs,j", po::value<size_t>()->default_value(1), "Build up to N independent images at the same time. Image waits for the image it's built from");
+        desc.add_options()("fail-fast", "Cancel running image builds as soon as one of them fails");
+        desc.add_options()("keep-going", "Don't stop on failed image: build all images which are not built from it and report every failure at the end");
+        desc.add_options()("pull-jobs", po::value<size_t>()->default_value(4), "Pull up to N missing source images at the same time before build starts, 0 - pull every image when it's build starts");
+        desc.add_options()("trace", po::value<std::string>(), "Write build timeline to file in Chrome trace format (open in ui.perfetto.dev or chrome://tracing)");
         desc.add_options()("env,e", po::value<std::vector<std::string>>(), "Pass build-time environment variables (-e A=1 -e B=2)");
         break;
 
@@ -159,6 +175,32 @@ int main(int argc, char** argv) {
     opts.stateless = vm.count("stateless");
     opts.no_cleanup = vm.count("no-cleanup");
     opts.copy_local = vm.count("copy-local");
+    opts.session = vm.count("session");
+    opts.sync = vm.count("sync");
+    opts.config_cache = !vm.count("no-config-cache");
+    if (vm.count("trace")) {
+        dockerpack::tracer::instance().enable(vm.at("trace").as<std::string>());
+    }
+    if (vm.count("backend")) {
+        opts.backend = vm.at("backend").as<std::string>();
+    }
+    if (vm.count("jobs")) {
+        opts.jobs = vm.at("jobs").as<size_t>();
+    }
+    if (vm.count("pull-jobs")) {
+        opts.pull_jobs = vm.at("pull-jobs").as<size_t>();
+    }
+    if (vm.count("warm")) {
+        opts.warm = vm.at("warm").as<size_t>();
+    }
+    if (vm.count("fail-fast") && vm.count("keep-going")) {
+        std::cerr << "Options --fail-fast and --keep-going can't be used together" << std::endl;
+        return 1;
+    } else if (vm.count("fail-fast")) {
+        opts.on_failure = dockerpack::failure_policy::fail_fast;
+    } else if (vm.count("keep-going")) {
+        opts.on_failure = dockerpack::failure_policy::keep_going;
+    }
     if (vm.count("name")) {
         opts.filter_name = vm.at("name").as<std::string>();
     }
@@ -172,6 +214,8 @@ int main(int argc, char** argv) {
 
     state_path = cwd + "/" + dockerpack::STATE_FILE;
 
+    // copy streams report closed pipe or socket as write error instead of killing the process
+    signal(SIGPIPE, SIG_IGN);
     signal(SIGINT, [](int signum) {
         if (boost::filesystem::exists(state_path)) {
             std::cout << "sigint caught; removing lock file." << std::endl;
@@ -203,12 +247,14 @@ int main(int argc, char** argv) {
             break;
         }
 
+        dockerpack::tracer::instance().save();
         if (!ret) {
             return 1;
         }
 
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
+        dockerpack::tracer::instance().save();
         return 1;
     }
 
@@ -0,0 +1,155 @@
+/*!
+ * dockerpack.
+ * matrix.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "matrix.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+
+const std::string dockerpack::job_matrix::IMAGE_AXIS = "image";
+
+/// \brief Axis "build_type" is passed as BUILD_TYPE
+static std::string env_name(const std::string& axis) {
+    std::string out = axis;
+    for (char& c : out) {
+        c = (char) std::toupper((unsigned char) c);
+    }
+    return out;
+}
+
+static const std::string* cell_value(const dockerpack::job_matrix::cell_t& cell, const std::string& axis) {
+    for (const auto& kv : cell) {
+        if (kv.first == axis) {
+            return &kv.second;
+        }
+    }
+    return nullptr;
+}
+
+bool dockerpack::job_matrix::empty() const {
+    return axes.empty() && include.empty();
+}
+
+bool dockerpack::job_matrix::excluded(const cell_t& cell) const {
+    for (const auto& rule : exclude) {
+        bool match = true;
+        for (const auto& kv : rule) {
+            const std::string* value = cell_value(cell, kv.first);
+            if (value == nullptr || *value != kv.second) {
+                match = false;
+                break;
+            }
+        }
+        if (match) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool dockerpack::job_matrix::contains(const cell_t& cell) const {
+    if (cell.size() != axes.size()) {
+        return false;
+    }
+    for (const auto& ax : axes) {
+        const std::string* value = cell_value(cell, ax.name);
+        if (value == nullptr || std::find(ax.values.begin(), ax.values.end(), *value) == ax.values.end()) {
+            return false;
+        }
+    }
+    return !excluded(cell);
+}
+
+void dockerpack::job_matrix::describe(const cell_t& cell, dockerpack::job& job) {
+    job.image.clear();
+    job.name.clear();
+    std::string suffix;
+    for (const auto& kv : cell) {
+        if (kv.first == IMAGE_AXIS) {
+            job.image = kv.second;
+        } else {
+            suffix += "_" + dockerpack::utils::clean_name(kv.second);
+        }
+    }
+    job.name = dockerpack::utils::clean_name(job.image) + suffix;
+}
+
+dockerpack::job_ptr_t dockerpack::job_matrix::make_job(const cell_t& cell, const dockerpack::job& probe) const {
+    job_ptr_t job = std::make_shared<dockerpack::job>();
+    job->name = probe.name;
+    job->image = probe.image;
+    job->envs = envs;
+    for (const auto& kv : cell) {
+        if (kv.first != IMAGE_AXIS) {
+            job->envs[env_name(kv.first)] = kv.second;
+        }
+    }
+    job->steps = steps;
+    return job;
+}
+
+void dockerpack::job_matrix::for_each_cell(const cell_visitor_t& visitor) const {
+    // only name and image are filled, visitor creates job itself if it needs one
+    dockerpack::job probe;
+
+    bool has_cells = !axes.empty();
+    for (const auto& ax : axes) {
+        has_cells = has_cells && !ax.values.empty();
+    }
+
+    if (has_cells) {
+        std::vector<size_t> index(axes.size(), 0);
+        cell_t cell;
+        cell.reserve(axes.size());
+        for (const auto& ax : axes) {
+            cell.emplace_back(ax.name, ax.values[0]);
+        }
+
+        while (true) {
+            if (!excluded(cell)) {
+                describe(cell, probe);
+                visitor(cell, probe);
+            }
+
+            // next cell: the last axis changes first, so jobs of the same image go one by one
+            bool next = false;
+            for (size_t i = axes.size(); i-- > 0 && !next;) {
+                if (++index[i] < axes[i].values.size()) {
+                    next = true;
+                } else {
+                    index[i] = 0;
+                }
+                cell[i].second = axes[i].values[index[i]];
+            }
+            if (!next) {
+                break;
+            }
+        }
+    }
+
+    for (const auto& cell : include) {
+        describe(cell, probe);
+        visitor(cell, probe);
+    }
+}
+
+void dockerpack::job_matrix::select(const job_filter_t& filter, std::vector<job_ptr_t>& out) const {
+    for_each_cell([this, &filter, &out](const cell_t& cell, const dockerpack::job& probe) {
+        if (filter(probe)) {
+            out.push_back(make_job(cell, probe));
+        }
+    });
+}
+
+void dockerpack::job_matrix::visit(const job_visitor_t& visitor) const {
+    for_each_cell([&visitor](const cell_t&, const dockerpack::job& probe) {
+        visitor(probe);
+    });
+}
@@ -0,0 +1,72 @@
+/*!
+ * dockerpack.
+ * matrix.h
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#ifndef DOCKERPACK_MATRIX_H
+#define DOCKERPACK_MATRIX_H
+
+#include "data.h"
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dockerpack {
+
+/// \brief Decides if job should be built. Job passed to it has only name and image
+using job_filter_t = std::function<bool(const dockerpack::job& job)>;
+/// \brief Receives every job of config without creating it. Job passed to it has only name and image
+using job_visitor_t = std::function<void(const dockerpack::job& job)>;
+
+/// \brief Multijob matrix: every cell of cartesian product of axes is a job. Jobs are not stored,
+/// select() creates them only for cells which pass the filter, so large matrices cost nothing until they are built.
+/// Axis "image" is the job image, other axes are passed to job as environment variables with upper case names.
+class job_matrix {
+public:
+    /// \brief Axis name -> value pairs, "image" is the first one
+    using cell_t = std::vector<std::pair<std::string, std::string>>;
+
+    struct axis {
+        std::string name;
+        std::vector<std::string> values;
+    };
+
+    static const std::string IMAGE_AXIS;
+
+    // "image" axis is the first one
+    std::vector<axis> axes;
+    // cell is excluded if it has all values of any rule
+    std::vector<cell_t> exclude;
+    // extra cells, they are never excluded
+    std::vector<cell_t> include;
+    // environment of every job (global and multijob ones), axes values override it
+    env_map envs;
+    std::vector<const step*> steps;
+
+    bool empty() const;
+    /// \brief Cell is a part of product and is not excluded
+    bool contains(const cell_t& cell) const;
+    /// \brief Create jobs of all cells accepted by filter
+    void select(const job_filter_t& filter, std::vector<job_ptr_t>& out) const;
+    /// \brief Pass every cell to visitor without creating jobs
+    void visit(const job_visitor_t& visitor) const;
+
+private:
+    using cell_visitor_t = std::function<void(const cell_t& cell, const dockerpack::job& probe)>;
+
+    /// \brief Iterate over product cells which are not excluded, then over included cells
+    void for_each_cell(const cell_visitor_t& visitor) const;
+    bool excluded(const cell_t& cell) const;
+    /// \brief Fill name and image of job from cell values
+    static void describe(const cell_t& cell, dockerpack::job& job);
+    job_ptr_t make_job(const cell_t& cell, const dockerpack::job& probe) const;
+};
+
+} // namespace dockerpack
+
+#endif //DOCKERPACK_MATRIX_H
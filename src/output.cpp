@@ -0,0 +1,75 @@
+/*!
+ * dockerpack.
+ * output.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "output.h"
+
+#include <boost/filesystem.hpp>
+
+std::mutex& dockerpack::output::lock() {
+    static std::mutex console_lock;
+    return console_lock;
+}
+
+dockerpack::output::output(std::string prefix, std::ostream& os)
+    : m_prefix(std::move(prefix)),
+      m_os(os) {
+}
+
+dockerpack::output& dockerpack::output::operator<<(manip_t manip) {
+    m_parts.emplace_back("", manip);
+    return *this;
+}
+
+dockerpack::output::~output() {
+    const manip_t endl = std::endl;
+
+    std::lock_guard<std::mutex> guard(lock());
+    bool line_start = true;
+    for (const auto& part : m_parts) {
+        if (part.second != nullptr) {
+            if (part.second == endl) {
+                line_start = true;
+            } else if (line_start && !m_prefix.empty()) {
+                m_os << m_prefix;
+                line_start = false;
+            }
+            part.second(m_os);
+            continue;
+        }
+
+        for (char c : part.first) {
+            if (line_start && c != '\n' && !m_prefix.empty()) {
+                m_os << m_prefix;
+            }
+            line_start = c == '\n';
+            m_os << c;
+        }
+    }
+    m_os.flush();
+}
+
+dockerpack::log_file::log_file(const std::string& path)
+    : m_path(path),
+      m_buffer(64 * 1024) {
+    boost::filesystem::create_directories(boost::filesystem::path(path).parent_path());
+    // buffer must be set before opening
+    m_os.rdbuf()->pubsetbuf(m_buffer.data(), m_buffer.size());
+    m_os.open(path, std::ios::out | std::ios::trunc);
+    if (!m_os.is_open()) {
+        throw std::runtime_error("Unable to open log " + path);
+    }
+}
+
+void dockerpack::log_file::write(const std::string& line) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_os << line << '\n';
+}
+
+const std::string& dockerpack::log_file::path() const {
+    return m_path;
+}
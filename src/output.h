@@ -0,0 +1,73 @@
+/*!
+ * dockerpack.
+ * output.h
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#ifndef DOCKERPACK_OUTPUT_H
+#define DOCKERPACK_OUTPUT_H
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace dockerpack {
+
+/// \brief Console message that is written at once when it goes out of scope.
+/// Concurrent jobs share a terminal, so every message is collected first and then flushed under
+/// a single global lock. Each line is prefixed with the given prefix (for example "[job] ").
+class output {
+public:
+    using manip_t = std::ostream& (*) (std::ostream&);
+
+    static std::mutex& lock();
+
+    explicit output(std::string prefix = "", std::ostream& os = std::cout);
+    output(const output&) = delete;
+    output& operator=(const output&) = delete;
+    ~output();
+
+    template<typename T>
+    output& operator<<(const T& value) {
+        std::stringstream ss;
+        ss << value;
+        m_parts.emplace_back(ss.str(), nullptr);
+        return *this;
+    }
+
+    output& operator<<(manip_t manip);
+
+private:
+    std::string m_prefix;
+    std::ostream& m_os;
+    std::vector<std::pair<std::string, manip_t>> m_parts;
+};
+
+/// \brief Buffered log of command output. Lines can be written from different threads (stdout and stderr readers)
+class log_file {
+public:
+    /// \brief Create or truncate file, parent directories are created
+    /// \throws std::runtime_error if file can't be opened
+    explicit log_file(const std::string& path);
+    log_file(const log_file&) = delete;
+    log_file& operator=(const log_file&) = delete;
+
+    void write(const std::string& line);
+    const std::string& path() const;
+
+private:
+    std::string m_path;
+    std::mutex m_lock;
+    std::vector<char> m_buffer;
+    std::ofstream m_os;
+};
+
+} // namespace dockerpack
+
+#endif //DOCKERPACK_OUTPUT_H
@@ -0,0 +1,159 @@
+/*!
+ * dockerpack.
+ * scheduler.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "scheduler.h"
+
+#include "output.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <termcolor/termcolor.hpp>
+#include <thread>
+
+namespace style = termcolor;
+
+static bool run_task(const dockerpack::scheduler::task_t& task) {
+    try {
+        return task();
+    } catch (const std::exception& e) {
+        dockerpack::output(std::string(), std::cerr) << style::red << "Unhandled task error: " << e.what() << style::reset << std::endl;
+        return false;
+    }
+}
+
+dockerpack::scheduler::scheduler(size_t workers, failure_policy policy)
+    : m_workers(workers == 0 ? 1 : workers),
+      m_policy(policy) {
+}
+
+size_t dockerpack::scheduler::add(task_t task, std::vector<size_t> deps) {
+    m_tasks.push_back(node{std::move(task), std::move(deps)});
+    return m_tasks.size() - 1;
+}
+
+void dockerpack::scheduler::on_cancel(cancel_handler_t handler) {
+    m_on_cancel = std::move(handler);
+}
+
+bool dockerpack::scheduler::run() {
+    const size_t total = m_tasks.size();
+
+    std::vector<size_t> pending(total, 0);
+    std::vector<std::vector<size_t>> dependents(total);
+    // min-heap: the earliest added task goes first
+    std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> ready;
+    for (size_t i = 0; i < total; i++) {
+        for (size_t dep : m_tasks[i].deps) {
+            if (dep >= total || dep == i) {
+                throw std::out_of_range("scheduler: invalid dependency index " + std::to_string(dep));
+            }
+            pending[i]++;
+            dependents[dep].push_back(i);
+        }
+        if (pending[i] == 0) {
+            ready.push(i);
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable cv;
+    size_t running = 0;
+    size_t done = 0;
+    size_t skipped = 0;
+    std::vector<bool> skipped_tasks(total, false);
+    bool failed = false;
+    // no new tasks are started
+    bool stopped = false;
+
+    // dependents of failed task will never be ready
+    const auto skip_dependents = [&](size_t idx) {
+        std::vector<size_t> stack(dependents[idx]);
+        while (!stack.empty()) {
+            const size_t next = stack.back();
+            stack.pop_back();
+            if (skipped_tasks[next]) {
+                continue;
+            }
+            skipped_tasks[next] = true;
+            skipped++;
+            stack.insert(stack.end(), dependents[next].begin(), dependents[next].end());
+        }
+    };
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            cv.wait(guard, [&] {
+                return stopped || !ready.empty() || running == 0;
+            });
+            if (stopped || ready.empty()) {
+                break;
+            }
+
+            const size_t idx = ready.top();
+            ready.pop();
+            running++;
+
+            guard.unlock();
+            const bool ok = run_task(m_tasks[idx].task);
+            guard.lock();
+
+            running--;
+            done++;
+            if (!ok) {
+                const bool first = !failed;
+                failed = true;
+                if (m_policy == failure_policy::keep_going) {
+                    skip_dependents(idx);
+                } else {
+                    stopped = true;
+                }
+                if (first && m_policy == failure_policy::fail_fast && m_on_cancel) {
+                    cv.notify_all();
+                    // other workers may finish their tasks while running ones are interrupted
+                    guard.unlock();
+                    m_on_cancel();
+                    guard.lock();
+                }
+            } else {
+                for (size_t next : dependents[idx]) {
+                    if (--pending[next] == 0) {
+                        ready.push(next);
+                    }
+                }
+            }
+            cv.notify_all();
+        }
+    };
+
+    const size_t n = std::min(m_workers, total);
+    if (n <= 1) {
+        worker();
+    } else {
+        std::vector<std::thread> threads;
+        threads.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            threads.emplace_back(worker);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    if (skipped) {
+        dockerpack::output(std::string(), std::cerr) << style::red << "Skipped " << skipped << " task(s) depending on failed ones" << style::reset << std::endl;
+    }
+    if (!failed && done + skipped != total) {
+        dockerpack::output(std::string(), std::cerr) << style::red << "Unable to run " << (total - done) << " task(s): circular dependency" << style::reset << std::endl;
+        return false;
+    }
+
+    return !failed;
+}
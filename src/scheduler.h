@@ -0,0 +1,60 @@
+/*!
+ * dockerpack.
+ * scheduler.h
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#ifndef DOCKERPACK_SCHEDULER_H
+#define DOCKERPACK_SCHEDULER_H
+
+#include <functional>
+#include <vector>
+
+namespace dockerpack {
+
+/// \brief What to do with other tasks after a task has failed
+enum class failure_policy {
+    // don't start new tasks, wait for running ones
+    stop,
+    // run every task which doesn't depend on failed one, tasks depending on it are skipped
+    keep_going,
+    // don't start new tasks and call cancel handler to interrupt running ones
+    fail_fast,
+};
+
+/// \brief Fixed size worker pool which runs tasks in dependency order.
+/// A task starts only when all of it's dependencies are successfully finished. From all ready tasks
+/// the one that was added first is started first, so with a single worker (it runs in the calling thread)
+/// tasks are executed exactly in the order they were added. What happens after the first failed task depends on failure_policy.
+class scheduler {
+public:
+    using task_t = std::function<bool()>;
+    using cancel_handler_t = std::function<void()>;
+
+    explicit scheduler(size_t workers, failure_policy policy = failure_policy::stop);
+
+    /// \param task task to run, returns false on failure
+    /// \param deps indices of tasks (as returned by add()) which must be finished before this one
+    /// \return task index
+    size_t add(task_t task, std::vector<size_t> deps = {});
+    /// \brief Handler is called once on the first failure in fail_fast mode, in the thread of failed task
+    void on_cancel(cancel_handler_t handler);
+    bool run();
+
+private:
+    struct node {
+        task_t task;
+        std::vector<size_t> deps;
+    };
+
+    size_t m_workers;
+    failure_policy m_policy;
+    cancel_handler_t m_on_cancel;
+    std::vector<node> m_tasks;
+};
+
+} // namespace dockerpack
+
+#endif //DOCKERPACK_SCHEDULER_H
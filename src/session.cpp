@@ -0,0 +1,115 @@
+/*!
+ * dockerpack.
+ * session.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "session.h"
+
+#include "output.h"
+#include "utils.h"
+
+#include <random>
+#include <termcolor/termcolor.hpp>
+
+namespace style = termcolor;
+
+// appended to marker of stderr lines, exit code line has digits after marker
+static const std::string ERR_SUFFIX = "err:";
+
+static std::string make_marker() {
+    std::random_device rd;
+    std::mt19937_64 gen(rd());
+    std::stringstream ss;
+    ss << "__dockerpack_" << std::hex << gen() << "_";
+    return ss.str();
+}
+
+dockerpack::shell_session::shell_session(const std::string& container, const env_map& envs, bool debug)
+    : m_marker(make_marker()),
+      m_debug(debug) {
+    std::vector<std::string> args = {"exec", "-i"};
+    for (const auto& kv : envs) {
+        args.push_back("-e");
+        args.push_back(kv.first + "=" + kv.second);
+    }
+    args.push_back(container);
+    args.push_back("bash");
+
+    m_child = bp::child(bp::search_path("docker"), bp::args(args), bp::std_in < m_in, bp::std_out > m_out, bp::std_err > m_err, dockerpack::std_only_fds());
+
+    // everything that steps write to stderr is redirected, so here are only shell errors
+    m_err_printer = std::thread([this]() {
+        std::string line;
+        while (std::getline(m_err, line)) {
+            dockerpack::output(std::string(), std::cerr) << line << std::endl;
+        }
+    });
+}
+
+dockerpack::shell_session::~shell_session() {
+    std::error_code ec;
+    if (m_child.running(ec)) {
+        m_in << "exit" << std::endl;
+        m_in.pipe().close();
+        m_child.wait(ec);
+    }
+    if (m_err_printer.joinable()) {
+        m_err_printer.join();
+    }
+}
+
+bool dockerpack::shell_session::alive() const {
+    return m_alive;
+}
+
+int dockerpack::shell_session::exec(const exec_options& opts) {
+    if (!m_alive) {
+        throw std::runtime_error("Shell session has exited");
+    }
+
+    const std::string err_marker = m_marker + ERR_SUFFIX;
+    std::stringstream script;
+    // step stdout goes to fd 3, stderr lines are prefixed with error marker, so they are separated from stdout
+    script << "{ (\n";
+    if (!opts.workdir.empty()) {
+        script << "mkdir -p " << dockerpack::utils::shell_quote(opts.workdir) << " && cd " << dockerpack::utils::shell_quote(opts.workdir) << " || exit 1\n";
+    }
+    for (const auto& kv : opts.envs) {
+        script << "export " << kv.first << "=" << dockerpack::utils::shell_quote(kv.second) << "\n";
+    }
+    script << opts.command << "\n";
+    script << ") </dev/null 2>&1 1>&3 3>&- | while IFS= read -r l || [ -n \"$l\" ]; do printf '%s%s\\n' " << dockerpack::utils::shell_quote(err_marker) << " \"$l\"; done; ";
+    script << "printf '%s%d\\n' " << dockerpack::utils::shell_quote(m_marker) << " \"${PIPESTATUS[0]}\"; } 3>&1\n";
+
+    if (m_debug) {
+        dockerpack::output(opts.prefix) << "[debug] session exec: " << style::green << opts.command << style::reset << std::endl;
+    }
+
+    m_in << script.str();
+    m_in.flush();
+
+    std::string line;
+    while (std::getline(m_out, line)) {
+        const size_t marker_pos = line.find(m_marker);
+        if (marker_pos == std::string::npos) {
+            opts.emit(false, line);
+            continue;
+        }
+
+        // output without trailing newline is followed by the marker on the same line
+        if (marker_pos > 0) {
+            opts.emit(false, line.substr(0, marker_pos));
+        }
+        if (line.compare(marker_pos, err_marker.size(), err_marker) == 0) {
+            opts.emit(true, line.substr(marker_pos + err_marker.size()));
+            continue;
+        }
+        return std::stoi(line.substr(marker_pos + m_marker.size()));
+    }
+
+    m_alive = false;
+    throw std::runtime_error("Shell session has exited unexpectedly");
+}
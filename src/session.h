@@ -0,0 +1,51 @@
+/*!
+ * dockerpack.
+ * session.h
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#ifndef DOCKERPACK_SESSION_H
+#define DOCKERPACK_SESSION_H
+
+#include "data.h"
+#include "docker_backend.h"
+#include "execmd.h"
+
+#include <string>
+#include <thread>
+
+namespace dockerpack {
+
+/// \brief Long-lived "docker exec -i <container> bash" which executes steps one by one.
+/// Each step is written to bash stdin as a subshell with it's own workdir and environment,
+/// followed by a sentinel line with the step exit code. Step stderr lines are sent through the same pipe prefixed
+/// with their own marker, so they stay stderr and are printed even if command output is disabled.
+class shell_session {
+public:
+    shell_session(const std::string& container, const env_map& envs, bool debug = false);
+    shell_session(const shell_session&) = delete;
+    shell_session& operator=(const shell_session&) = delete;
+    ~shell_session();
+
+    /// \brief Run step and wait for it's sentinel. Workdir is created if not exists.
+    /// \return step exit code
+    /// \throws std::runtime_error if shell has exited
+    int exec(const exec_options& opts);
+    bool alive() const;
+
+private:
+    std::string m_marker;
+    bool m_debug;
+    bool m_alive = true;
+    bp::opstream m_in;
+    bp::ipstream m_out;
+    bp::ipstream m_err;
+    bp::child m_child;
+    std::thread m_err_printer;
+};
+
+} // namespace dockerpack
+
+#endif //DOCKERPACK_SESSION_H
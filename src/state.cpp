@@ -9,109 +9,320 @@
 
 #include "state.h"
 
+#include "utils.h"
+
+#include <algorithm>
 #include <boost/filesystem.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
+#include <iostream>
 #include <nlohmann/json.hpp>
-#include <toolbox/io.h>
+#include <sys/stat.h>
 #include <toolbox/strings.hpp>
+#include <unistd.h>
 
 namespace fs = boost::filesystem;
 
+static const std::string JOURNAL_HEADER = "dockerpack-state\t1";
+
+static size_t total_size(const dockerpack::sstep_t& steps) {
+    size_t size = 0;
+    for (const auto& kv : steps) {
+        size += kv.second.size();
+    }
+    return size;
+}
+
 dockerpack::state::state(std::string save_path)
     : save_path(std::move(save_path)),
       last_build_time((uint64_t) time(nullptr)) {
 }
+dockerpack::state::~state() {
+    close_journal();
+}
 void dockerpack::state::load() {
-    if (!exists() || !m_enable) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!fs::exists(save_path) || !m_enable) {
         return;
     }
-    nlohmann::json j;
-    std::ifstream is(save_path, std::ios::in);
+    std::ifstream is(save_path, std::ios::in | std::ios::binary);
     if (!is.is_open()) {
         std::cerr << "Can't open file " << save_path << "\n";
         return;
     }
+    const std::string content((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    is.close();
+
+    if (!content.empty() && content[0] == '{') {
+        // state of previous versions
+        load_json(content);
+        compact();
+        return;
+    }
 
-    is >> j;
+    // other format version or not a journal at all: records can't be trusted
+    if (content.compare(0, JOURNAL_HEADER.size() + 1, JOURNAL_HEADER + "\n") != 0) {
+        if (!content.empty()) {
+            std::cerr << "Unknown state format of " << save_path << ", state is reset\n";
+            compact();
+        }
+        return;
+    }
 
-    success_jobs = j.at("success_jobs").get<sjob_t>();
-    success_steps = j.at("success_steps").get<sstep_t>();
-    success_build_steps = j.at("success_build_steps").get<sstep_t>();
+    const size_t records = replay(content);
+    // header and build time are the only records besides state itself
+    const size_t state_size = 2 + success_jobs.size() + total_size(success_steps) + total_size(success_build_steps) + checkpoints.size();
+    // partially written record must not be continued by next append
+    const bool truncated = !content.empty() && content.back() != '\n';
+    if (records > state_size || truncated) {
+        compact();
+    }
+}
+void dockerpack::state::load_json(const std::string& content) {
+    const auto j = nlohmann::json::parse(content);
+    for (const auto& job : j.at("success_jobs")) {
+        success_jobs.insert(toolbox::strings::to_lower_case(job.get<std::string>()));
+    }
+    // steps were keyed by name and command hash, chained step keys never match them, so they are dropped
+}
+size_t dockerpack::state::replay(const std::string& content) {
+    size_t records = 0;
+    size_t pos = 0;
+    while (pos < content.size()) {
+        const size_t end = content.find('\n', pos);
+        if (end == std::string::npos) {
+            // last record has been written partially
+            break;
+        }
+        const std::string line = content.substr(pos, end - pos);
+        pos = end + 1;
+        if (line.empty()) {
+            continue;
+        }
+        apply(toolbox::strings::split(line, "\t"));
+        records++;
+    }
+    return records;
+}
+void dockerpack::state::apply(const std::vector<std::string>& record) {
+    const std::string& type = record[0];
+    digest_t key;
+    if (type == "J" && record.size() == 2) {
+        success_jobs.insert(toolbox::strings::to_lower_case(record[1]));
+    } else if (type == "S" && record.size() == 3 && from_hex(record[2], key)) {
+        success_steps[record[1]].insert(key);
+    } else if (type == "B" && record.size() == 3 && from_hex(record[2], key)) {
+        success_build_steps[record[1]].insert(key);
+    } else if (type == "R" && record.size() == 2) {
+        success_steps.erase(record[1]);
+    } else if (type == "C" && record.size() == 3 && from_hex(record[1], key)) {
+        checkpoints[key] = record[2];
+    } else if (type == "D" && record.size() == 2 && from_hex(record[1], key)) {
+        checkpoints.erase(key);
+    }
+    // header and build time "T" records do not change state
+}
+void dockerpack::state::compact() {
+    std::stringstream ss;
+    ss << JOURNAL_HEADER << "\n";
+    ss << "T\t" << last_build_time << "\n";
+    for (const auto& job : success_jobs) {
+        ss << "J\t" << job << "\n";
+    }
+    for (const auto& kv : success_steps) {
+        for (const auto& key : kv.second) {
+            ss << "S\t" << kv.first << "\t" << to_hex(key) << "\n";
+        }
+    }
+    for (const auto& kv : success_build_steps) {
+        for (const auto& key : kv.second) {
+            ss << "B\t" << kv.first << "\t" << to_hex(key) << "\n";
+        }
+    }
+    for (const auto& kv : checkpoints) {
+        ss << "C\t" << to_hex(kv.first) << "\t" << kv.second << "\n";
+    }
+
+    // journal file is replaced, so it have to be reopened
+    close_journal();
+    dockerpack::utils::write_file_atomic(save_path, ss.str());
+}
+void dockerpack::state::append(std::initializer_list<std::string> fields) {
+    bool first = true;
+    for (const auto& field : fields) {
+        if (!first) {
+            m_pending.push_back('\t');
+        }
+        m_pending += field;
+        first = false;
+    }
+    m_pending.push_back('\n');
+}
+void dockerpack::state::close_journal() {
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
 }
 bool dockerpack::state::exists() {
     return fs::exists(save_path);
 }
 void dockerpack::state::remove() {
-    if (exists()) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    close_journal();
+    m_pending.clear();
+    if (fs::exists(save_path)) {
         fs::remove(save_path);
     }
 }
 void dockerpack::state::enable(bool enable) {
     m_enable = enable;
 }
+void dockerpack::state::fsync(bool enable) {
+    m_fsync = enable;
+}
 void dockerpack::state::save() {
-    if (!m_enable)
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_enable || (m_pending.empty() && !m_rewrite))
         return;
-    nlohmann::json j;
-    j["last_build_time"] = last_build_time;
-    j["success_jobs"] = success_jobs;
-    j["success_steps"] = success_steps;
-    j["success_build_steps"] = success_build_steps;
 
-    const auto res = j.dump();
-    toolbox::io::file_write_string(save_path, res);
-}
-bool dockerpack::state::has_success_step(const std::shared_ptr<dockerpack::job>& job, const std::shared_ptr<dockerpack::step>& step) {
-    if (!m_enable)
-        return false;
-    if (!success_steps.count(job->job_name())) {
-        return false;
+    if (m_rewrite) {
+        // in-memory state already contains pending records
+        try {
+            compact();
+            m_pending.clear();
+            m_rewrite = false;
+        } catch (const std::exception& e) {
+            std::cerr << "Can't write file " << save_path << ": " << e.what() << "\n";
+        }
+        return;
     }
 
-    return std::any_of(success_steps[job->job_name()].begin(), success_steps[job->job_name()].end(), [step](const std::string& j) {
-        return toolbox::strings::equals_icase(step->hash(), j);
-    });
+    if (m_fd == -1) {
+        m_fd = ::open(save_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (m_fd == -1) {
+            std::cerr << "Can't open file " << save_path << ": " << std::strerror(errno) << "\n";
+            return;
+        }
+    }
+
+    struct stat st {};
+    if (::fstat(m_fd, &st) != 0) {
+        std::cerr << "Can't stat file " << save_path << ": " << std::strerror(errno) << "\n";
+        close_journal();
+        return;
+    }
+    // header is not part of pending records, so it's not written twice if write is retried
+    const std::string buffer = st.st_size == 0 ? JOURNAL_HEADER + "\nT\t" + std::to_string(last_build_time) + "\n" + m_pending : m_pending;
+
+    const char* data = buffer.data();
+    size_t left = buffer.size();
+    while (left > 0) {
+        const ssize_t written = ::write(m_fd, data, left);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Can't write file " << save_path << ": " << std::strerror(errno) << "\n";
+            // half written record would be merged with the next one: cut it off, or rewrite whole journal next time
+            if (left != buffer.size() && ::ftruncate(m_fd, st.st_size) != 0) {
+                m_rewrite = true;
+            }
+            close_journal();
+            return;
+        }
+        data += written;
+        left -= (size_t) written;
+    }
+    m_pending.clear();
+
+    if (m_fsync) {
+        ::fdatasync(m_fd);
+    }
 }
-bool dockerpack::state::has_success_build_step(const dockerpack::imb_ptr_t& job, const std::shared_ptr<dockerpack::step>& step) {
+bool dockerpack::state::has_success_step(const std::shared_ptr<dockerpack::job>& job, const digest_t& step_key) {
+    std::lock_guard<std::mutex> lock(m_lock);
     if (!m_enable)
         return false;
-    if (!success_build_steps.count(job->job_name())) {
+    const auto it = success_steps.find(job->job_name());
+    return it != success_steps.end() && it->second.count(step_key);
+}
+bool dockerpack::state::has_success_build_step(const dockerpack::imb_ptr_t& job, const digest_t& step_key) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_enable)
         return false;
-    }
-
-    return std::any_of(success_build_steps[job->job_name()].begin(), success_build_steps[job->job_name()].end(), [step](const std::string& j) {
-        return toolbox::strings::equals_icase(step->hash(), j);
-    });
+    const auto it = success_build_steps.find(job->job_name());
+    return it != success_build_steps.end() && it->second.count(step_key);
 }
 bool dockerpack::state::has_success_job(const std::shared_ptr<dockerpack::job>& job) {
+    return has_success_job(*job);
+}
+bool dockerpack::state::has_success_job(const dockerpack::job& job) {
+    std::lock_guard<std::mutex> lock(m_lock);
     if (!m_enable)
         return false;
-    return std::any_of(success_jobs.begin(), success_jobs.end(), [job](const std::string& j) {
-        return toolbox::strings::equals_icase(job->job_name(), j);
-    });
+    return success_jobs.count(toolbox::strings::to_lower_case(job.job_name()));
 }
 void dockerpack::state::add_success_job(const std::shared_ptr<dockerpack::job>& job) {
+    std::lock_guard<std::mutex> lock(m_lock);
     if (!m_enable)
         return;
-    if (!has_success_job(job)) {
-        success_jobs.push_back(job->job_name());
+    // job names are case insensitive
+    std::string name = toolbox::strings::to_lower_case(job->job_name());
+    if (success_jobs.insert(name).second) {
+        append({"J", name});
     }
 }
-void dockerpack::state::add_success_step(const std::shared_ptr<dockerpack::job>& job, const std::shared_ptr<dockerpack::step>& step) {
+void dockerpack::state::add_success_step(const std::shared_ptr<dockerpack::job>& job, const dockerpack::step_ptr_t& step, const digest_t& step_key) {
+    std::lock_guard<std::mutex> lock(m_lock);
     if (!m_enable || step->stateless)
         return;
-    if (!success_steps.count(job->job_name())) {
-        success_steps[job->job_name()] = std::vector<std::string>();
+    if (success_steps[job->job_name()].insert(step_key).second) {
+        append({"S", job->job_name(), to_hex(step_key)});
     }
-
-    success_steps[job->job_name()].push_back(step->hash());
 }
-void dockerpack::state::add_success_build_step(const std::shared_ptr<dockerpack::image_to_build>& job, const std::shared_ptr<dockerpack::step>& step) {
+void dockerpack::state::add_success_build_step(const std::shared_ptr<dockerpack::image_to_build>& job, const dockerpack::step_ptr_t& step, const digest_t& step_key) {
+    std::lock_guard<std::mutex> lock(m_lock);
     if (!m_enable || step->stateless)
         return;
-    if (!success_build_steps.count(job->job_name())) {
-        success_build_steps[job->job_name()] = std::vector<std::string>();
+    if (success_build_steps[job->job_name()].insert(step_key).second) {
+        append({"B", job->job_name(), to_hex(step_key)});
     }
-
-    success_build_steps[job->job_name()].push_back(step->hash());
+}
+void dockerpack::state::reset_success_steps(const std::shared_ptr<dockerpack::job>& job) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_enable)
+        return;
+    if (success_steps.erase(job->job_name())) {
+        append({"R", job->job_name()});
+    }
+}
+std::string dockerpack::state::get_checkpoint(const digest_t& chain_key) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_enable)
+        return std::string();
+    const auto it = checkpoints.find(chain_key);
+    return it == checkpoints.end() ? std::string() : it->second;
+}
+void dockerpack::state::add_checkpoint(const digest_t& chain_key, const std::string& image) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_enable)
+        return;
+    checkpoints[chain_key] = image;
+    append({"C", to_hex(chain_key), image});
+}
+std::vector<std::string> dockerpack::state::remove_checkpoints(const std::vector<dockerpack::digest_t>& chain_keys) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    std::vector<std::string> out;
+    for (const auto& key : chain_keys) {
+        const auto it = checkpoints.find(key);
+        if (it != checkpoints.end()) {
+            out.push_back(it->second);
+            checkpoints.erase(it);
+            append({"D", to_hex(key)});
+        }
+    }
+    return out;
 }
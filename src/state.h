@@ -11,41 +11,86 @@
 
 #include "config.h"
 
+#include <initializer_list>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace dockerpack {
 
-using sstep_t = std::unordered_map<std::string, std::vector<std::string>>;
-using sjob_t = std::vector<std::string>;
+using digest_set_t = std::unordered_set<digest_t, digest_hasher>;
+// job name -> step chain keys
+using sstep_t = std::unordered_map<std::string, digest_set_t>;
+// lowercase job names
+using sjob_t = std::unordered_set<std::string>;
+// step chain key -> snapshot image reference. Snapshot can be used by any job with the same steps chain prefix
+using scheckpoint_t = std::unordered_map<digest_t, std::string, digest_hasher>;
 
+/// \brief Build state stored as append-only journal: one line per change, fields separated by tab.
+/// Changes are buffered in memory and appended to file by save(), so saving costs the same for every step.
+/// load() replays journal and compacts it if it contains overwritten records. Legacy JSON state is converted on load.
 class state {
 public:
     explicit state(std::string save_path);
+    ~state();
 
     void load();
+    /// \brief Append changes made since previous save
     void save();
     bool exists();
     void remove();
     void enable(bool enable);
+    /// \brief Flush journal to disk after every save (default), otherwise leave it to OS
+    void fsync(bool enable);
 
-    bool has_success_step(const std::shared_ptr<dockerpack::job>& job, const std::shared_ptr<dockerpack::step>& step);
-    bool has_success_build_step(const imb_ptr_t& job, const std::shared_ptr<dockerpack::step>& step);
+    /// \param step_key step chain key, see docker::step_keys()
+    bool has_success_step(const std::shared_ptr<dockerpack::job>& job, const digest_t& step_key);
+    bool has_success_build_step(const imb_ptr_t& job, const digest_t& step_key);
     bool has_success_job(const std::shared_ptr<dockerpack::job>& job);
+    bool has_success_job(const dockerpack::job& job);
 
     void add_success_job(const std::shared_ptr<dockerpack::job>& job);
-    void add_success_step(const std::shared_ptr<dockerpack::job>& job, const std::shared_ptr<dockerpack::step>& step);
-    void add_success_build_step(const std::shared_ptr<dockerpack::image_to_build>& job, const std::shared_ptr<dockerpack::step>& step);
+    void add_success_step(const std::shared_ptr<dockerpack::job>& job, const step_ptr_t& step, const digest_t& step_key);
+    void add_success_build_step(const std::shared_ptr<dockerpack::image_to_build>& job, const step_ptr_t& step, const digest_t& step_key);
+    /// \brief Forget job success steps: job container was created again, so their results are lost
+    void reset_success_steps(const std::shared_ptr<dockerpack::job>& job);
+
+    /// \return snapshot image reference or empty string if there is no checkpoint for given step chain key
+    std::string get_checkpoint(const digest_t& chain_key);
+    void add_checkpoint(const digest_t& chain_key, const std::string& image);
+    /// \brief Forget checkpoints of given step chain keys
+    /// \return snapshot images of removed checkpoints
+    std::vector<std::string> remove_checkpoints(const std::vector<digest_t>& chain_keys);
 
 private:
+    void load_json(const std::string& content);
+    /// \return number of applied records
+    size_t replay(const std::string& content);
+    void apply(const std::vector<std::string>& record);
+    /// \brief Rewrite journal with current state only
+    void compact();
+    void append(std::initializer_list<std::string> fields);
+    void close_journal();
+
+    // state is shared between concurrent jobs
+    std::mutex m_lock;
     std::string save_path;
     uint64_t last_build_time;
     sjob_t success_jobs;
     sstep_t success_steps;
     sstep_t success_build_steps;
+    scheckpoint_t checkpoints;
     bool m_enable = true;
+    bool m_fsync = true;
+    // appended journal file descriptor, opened on first save
+    int m_fd = -1;
+    // records which are not saved yet
+    std::string m_pending;
+    // partially written record could not be truncated: journal is rewritten by next save
+    bool m_rewrite = false;
 };
 
 } // namespace dockerpack
@@ -0,0 +1,202 @@
+/*!
+ * dockerpack.
+ * sync.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "sync.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <sodium/crypto_hash_sha256.h>
+#include <thread>
+#include <unordered_set>
+
+namespace fs = boost::filesystem;
+
+static dockerpack::digest_t hash_file(const std::string& path) {
+    crypto_hash_sha256_state state;
+    crypto_hash_sha256_init(&state);
+
+    std::ifstream is(path, std::ios::in | std::ios::binary);
+    if (!is.is_open()) {
+        throw std::runtime_error("Unable to read " + path);
+    }
+    char buffer[64 * 1024];
+    while (is) {
+        is.read(buffer, sizeof(buffer));
+        crypto_hash_sha256_update(&state, reinterpret_cast<const unsigned char*>(buffer), (unsigned long long) is.gcount());
+    }
+
+    dockerpack::digest_t out;
+    crypto_hash_sha256_final(&state, out.data());
+    return out;
+}
+
+dockerpack::dir_sync::dir_sync(std::string local_root, std::string prefix, std::string manifest_path, ignore_rules rules, size_t threads)
+    : m_local_root(trim_directory(local_root)),
+      m_prefix(std::move(prefix)),
+      m_manifest_path(std::move(manifest_path)),
+      m_rules(std::move(rules)),
+      m_threads(std::max<size_t>(threads, 1)) {
+}
+
+dockerpack::sync_plan dockerpack::dir_sync::plan() {
+    m_previous = load_manifest(m_manifest_path);
+    m_current = scan_directory(m_local_root, m_rules);
+
+    // entries with changed metadata have to be hashed to find out are they really changed
+    std::vector<std::pair<const std::string, file_entry>*> to_hash;
+    for (auto& kv : m_current) {
+        const auto prev = m_previous.find(kv.first);
+        if (prev != m_previous.end() && prev->second.same_stat(kv.second)) {
+            kv.second.hash = prev->second.hash;
+        } else if (kv.second.type != '5') {
+            to_hash.push_back(&kv);
+        }
+    }
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_lock;
+    const auto hasher = [&]() {
+        for (size_t i = next++; i < to_hash.size(); i = next++) {
+            auto& kv = *to_hash[i];
+            const std::string path = m_local_root + "/" + kv.first;
+            try {
+                if (kv.second.type == '0') {
+                    kv.second.hash = hash_file(path);
+                } else {
+                    kv.second.hash = dockerpack::sha256(fs::read_symlink(path).string());
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(error_lock);
+                error = std::current_exception();
+                next = to_hash.size();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min(m_threads, to_hash.size()); i++) {
+        workers.emplace_back(hasher);
+    }
+    hasher();
+    for (auto& t : workers) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    sync_plan out;
+    for (const auto& kv : m_current) {
+        const auto prev = m_previous.find(kv.first);
+        const file_entry& entry = kv.second;
+        // touched, but not changed
+        const bool changed = prev == m_previous.end() || prev->second.type != entry.type || prev->second.mode != entry.mode || prev->second.hash != entry.hash;
+        if (changed) {
+            out.changed.push_back(kv.first);
+            out.bytes += entry.size;
+        }
+    }
+
+    // "dir-x" goes between "dir" and "dir/a", so all deleted directories are kept, not only the last one
+    std::unordered_set<std::string> deleted_dirs;
+    const auto in_deleted_dir = [&deleted_dirs](const std::string& path) {
+        for (size_t pos = path.find('/'); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+            if (deleted_dirs.count(path.substr(0, pos))) {
+                return true;
+            }
+        }
+        return false;
+    };
+    for (const auto& kv : m_previous) {
+        if (m_current.count(kv.first)) {
+            continue;
+        }
+        // newly ignored entry is not deleted, it's just forgotten: manifest is replaced by scanned entries
+        if (ignored(kv.first, kv.second.type == '5')) {
+            continue;
+        }
+        // directory is removed recursively
+        if (in_deleted_dir(kv.first)) {
+            continue;
+        }
+        out.deleted.push_back(kv.first);
+        if (kv.second.type == '5') {
+            deleted_dirs.insert(kv.first);
+        }
+    }
+
+    return out;
+}
+
+bool dockerpack::dir_sync::ignored(const std::string& rel_path, bool is_dir) const {
+    if (m_rules.ignored(rel_path, is_dir)) {
+        return true;
+    }
+    // content of ignored directory is not scanned
+    for (size_t pos = rel_path.find('/'); pos != std::string::npos; pos = rel_path.find('/', pos + 1)) {
+        if (m_rules.ignored(rel_path.substr(0, pos), true)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void dockerpack::dir_sync::write_archive(const sync_plan& plan, std::ostream& out, const archive_options& opts) const {
+    dockerpack::write_archive(out, m_local_root, m_current, plan.changed, m_prefix, opts);
+}
+
+void dockerpack::dir_sync::commit() {
+    save_manifest(m_manifest_path, m_current);
+}
+
+dockerpack::sync_manifest_t dockerpack::dir_sync::load_manifest(const std::string& path) {
+    sync_manifest_t out;
+    std::ifstream is(path);
+    if (!is.is_open()) {
+        return out;
+    }
+    const auto j = nlohmann::json::parse(is, nullptr, false);
+    if (j.is_discarded() || !j.is_object() || j.value("version", 0) != 1) {
+        return out;
+    }
+
+    for (const auto& item : j.at("entries").items()) {
+        const auto& value = item.value();
+        file_entry entry;
+        entry.type = value.at(0).get<std::string>().at(0);
+        entry.mode = value.at(1).get<uint32_t>();
+        entry.size = value.at(2).get<uint64_t>();
+        entry.mtime = value.at(3).get<int64_t>();
+        if (!from_hex(value.at(4).get<std::string>(), entry.hash)) {
+            // will be hashed again
+            entry.mtime = -1;
+        }
+        out.emplace(item.key(), entry);
+    }
+    return out;
+}
+
+void dockerpack::dir_sync::save_manifest(const std::string& path, const sync_manifest_t& manifest) {
+    nlohmann::json entries = nlohmann::json::object();
+    for (const auto& kv : manifest) {
+        const file_entry& entry = kv.second;
+        entries[kv.first] = {std::string(1, entry.type), entry.mode, entry.size, entry.mtime, to_hex(entry.hash)};
+    }
+
+    nlohmann::json j;
+    j["version"] = 1;
+    j["entries"] = std::move(entries);
+    dockerpack::utils::write_file_atomic(path, j.dump());
+}
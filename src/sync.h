@@ -0,0 +1,75 @@
+/*!
+ * dockerpack.
+ * sync.h
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#ifndef DOCKERPACK_SYNC_H
+#define DOCKERPACK_SYNC_H
+
+#include "archive.h"
+#include "data.h"
+#include "ignore.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace dockerpack {
+
+// relative path -> entry of the previous sync
+using sync_manifest_t = file_tree_t;
+
+struct sync_plan {
+    // relative paths of new and changed entries
+    std::vector<std::string> changed;
+    // relative paths of entries removed locally. Entries which are ignored now are not deleted
+    std::vector<std::string> deleted;
+    // size of changed files
+    uint64_t bytes = 0;
+
+    bool empty() const {
+        return changed.empty() && deleted.empty();
+    }
+};
+
+/// \brief One-way incremental sync of local directory contents to container directory.
+/// Keeps manifest of the previous sync (path, size, mtime, mode, content hash) and transfers only
+/// new and changed entries. Content is hashed only if size, mtime or mode has changed.
+class dir_sync {
+public:
+    /// \param local_root local directory, it's contents are synced
+    /// \param prefix prepended to every name inside archive, empty or ending with "/"
+    /// \param manifest_path manifest of the previous sync to the same container and remote path
+    /// \param rules ignored entries are not transferred
+    /// \param threads number of threads hashing changed files
+    dir_sync(std::string local_root, std::string prefix, std::string manifest_path, ignore_rules rules, size_t threads);
+
+    /// \brief Scan local directory and compare it with manifest of the previous sync
+    sync_plan plan();
+    /// \brief Write tar stream with changed entries of the plan
+    void write_archive(const sync_plan& plan, std::ostream& out, const archive_options& opts) const;
+    /// \brief Save scanned manifest. Must be called only after changes are transferred
+    void commit();
+
+private:
+    /// \brief Entry or one of it's parent directories is ignored
+    bool ignored(const std::string& rel_path, bool is_dir) const;
+    static sync_manifest_t load_manifest(const std::string& path);
+    static void save_manifest(const std::string& path, const sync_manifest_t& manifest);
+
+    std::string m_local_root;
+    std::string m_prefix;
+    std::string m_manifest_path;
+    ignore_rules m_rules;
+    size_t m_threads;
+    sync_manifest_t m_previous;
+    sync_manifest_t m_current;
+};
+
+} // namespace dockerpack
+
+#endif //DOCKERPACK_SYNC_H
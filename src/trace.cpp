@@ -0,0 +1,149 @@
+/*!
+ * dockerpack.
+ * trace.cpp
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "trace.h"
+
+#include "utils.h"
+
+#include <nlohmann/json.hpp>
+#include <unistd.h>
+
+static thread_local std::string thread_track;
+
+dockerpack::tracer& dockerpack::tracer::instance() {
+    static tracer inst;
+    return inst;
+}
+
+dockerpack::tracer::tracer()
+    : m_enabled(false),
+      m_origin(clock::now()) {
+}
+
+void dockerpack::tracer::enable(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_path = path;
+    m_enabled = true;
+}
+
+bool dockerpack::tracer::enabled() const {
+    return m_enabled;
+}
+
+int64_t dockerpack::tracer::micros(clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(time - m_origin).count();
+}
+
+int dockerpack::tracer::track_id(const std::string& track) {
+    const auto it = m_tracks.find(track);
+    if (it != m_tracks.end()) {
+        return it->second;
+    }
+    const int id = (int) m_tracks.size();
+    m_tracks.emplace(track, id);
+    return id;
+}
+
+void dockerpack::tracer::complete(const std::string& name, const std::string& category, clock::time_point start, clock::time_point end, const std::string& detail) {
+    if (!m_enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_events.push_back({'X', track_id(thread_track), name, category, detail, micros(start), micros(end) - micros(start)});
+}
+
+void dockerpack::tracer::instant(const std::string& name, const std::string& category, const std::string& detail) {
+    if (!m_enabled) {
+        return;
+    }
+    const int64_t now = micros(clock::now());
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_events.push_back({'i', track_id(thread_track), name, category, detail, now, 0});
+}
+
+void dockerpack::tracer::save() {
+    if (!m_enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    const int pid = (int) getpid();
+    nlohmann::json events = nlohmann::json::array();
+    events.push_back({{"ph", "M"}, {"pid", pid}, {"name", "process_name"}, {"args", {{"name", "dockerpack"}}}});
+    for (const auto& kv : m_tracks) {
+        const std::string name = kv.first.empty() ? "dockerpack" : kv.first;
+        events.push_back({{"ph", "M"}, {"pid", pid}, {"tid", kv.second}, {"name", "thread_name"}, {"args", {{"name", name}}}});
+        events.push_back({{"ph", "M"}, {"pid", pid}, {"tid", kv.second}, {"name", "thread_sort_index"}, {"args", {{"sort_index", kv.second}}}});
+    }
+
+    for (const auto& e : m_events) {
+        nlohmann::json item = {
+            {"ph", std::string(1, e.phase)},
+            {"pid", pid},
+            {"tid", e.track},
+            {"name", e.name},
+            {"cat", e.category},
+            {"ts", e.ts},
+        };
+        if (e.phase == 'X') {
+            item["dur"] = e.dur;
+        } else {
+            // instant event is drawn on it's track only
+            item["s"] = "t";
+        }
+        if (!e.detail.empty()) {
+            item["args"] = {{"detail", e.detail}};
+        }
+        events.push_back(std::move(item));
+    }
+
+    nlohmann::json trace;
+    trace["traceEvents"] = std::move(events);
+    trace["displayTimeUnit"] = "ms";
+    dockerpack::utils::write_file_atomic(m_path, trace.dump());
+}
+
+void dockerpack::tracer::set_track(const std::string& track) {
+    thread_track = track;
+}
+
+const std::string& dockerpack::tracer::current_track() {
+    return thread_track;
+}
+
+dockerpack::trace_track::trace_track(const std::string& track)
+    : m_previous(tracer::current_track()) {
+    tracer::set_track(track);
+}
+
+dockerpack::trace_track::~trace_track() {
+    tracer::set_track(m_previous);
+}
+
+dockerpack::trace_span::trace_span(std::string name, std::string category, std::string detail)
+    : m_enabled(tracer::instance().enabled()) {
+    if (!m_enabled) {
+        return;
+    }
+    m_name = std::move(name);
+    m_category = std::move(category);
+    m_detail = std::move(detail);
+    m_start = tracer::clock::now();
+}
+
+dockerpack::trace_span::~trace_span() {
+    if (m_enabled) {
+        tracer::instance().complete(m_name, m_category, m_start, tracer::clock::now(), m_detail);
+    }
+}
+
+void dockerpack::trace_span::detail(const std::string& value) {
+    if (m_enabled) {
+        m_detail = value;
+    }
+}
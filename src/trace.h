@@ -0,0 +1,100 @@
+/*!
+ * dockerpack.
+ * trace.h
+ *
+ * \date 10/16/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#ifndef DOCKERPACK_TRACE_H
+#define DOCKERPACK_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dockerpack {
+
+/// \brief Collects build timeline in Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+/// Every job has it's own track. Events are kept in memory and written by save().
+/// Until enable() is called spans and markers do nothing.
+class tracer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static tracer& instance();
+
+    void enable(const std::string& path);
+    bool enabled() const;
+
+    /// \brief Span that has finished
+    void complete(const std::string& name, const std::string& category, clock::time_point start, clock::time_point end, const std::string& detail = "");
+    /// \brief Point in time marker, for example skipped step
+    void instant(const std::string& name, const std::string& category, const std::string& detail = "");
+    /// \brief Write trace file if tracing is enabled
+    void save();
+
+    /// \brief Events of the calling thread go to this track. Empty name is the main track
+    static void set_track(const std::string& track);
+    static const std::string& current_track();
+
+private:
+    struct event {
+        char phase;
+        int track;
+        std::string name;
+        std::string category;
+        std::string detail;
+        int64_t ts;
+        int64_t dur;
+    };
+
+    tracer();
+    int track_id(const std::string& track);
+    int64_t micros(clock::time_point time) const;
+
+    std::atomic<bool> m_enabled;
+    std::string m_path;
+    const clock::time_point m_origin;
+    std::mutex m_lock;
+    std::vector<event> m_events;
+    // track name -> id, in order of appearance
+    std::unordered_map<std::string, int> m_tracks;
+};
+
+/// \brief Switches track of the calling thread until goes out of scope
+class trace_track {
+public:
+    explicit trace_track(const std::string& track);
+    ~trace_track();
+
+private:
+    std::string m_previous;
+};
+
+/// \brief Duration event from construction till destruction
+class trace_span {
+public:
+    trace_span(std::string name, std::string category, std::string detail = "");
+    trace_span(const trace_span&) = delete;
+    trace_span& operator=(const trace_span&) = delete;
+    ~trace_span();
+
+    /// \brief Replace span details, for example with result
+    void detail(const std::string& value);
+
+private:
+    bool m_enabled;
+    std::string m_name;
+    std::string m_category;
+    std::string m_detail;
+    tracer::clock::time_point m_start;
+};
+
+} // namespace dockerpack
+
+#endif //DOCKERPACK_TRACE_H
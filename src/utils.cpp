@@ -9,7 +9,10 @@
 #include "utils.h"
 
 #include <boost/filesystem.hpp>
+#include <fstream>
+#include <stdexcept>
 #include <toolbox/strings.hpp>
+#include <vector>
 
 void dockerpack::utils::normalize_path(std::string& path) {
     toolbox::strings::trim_ref(path);
@@ -19,3 +22,90 @@ void dockerpack::utils::normalize_path(std::string& path) {
         toolbox::strings::replace("~", h, path);
     }
 }
+
+std::string dockerpack::utils::clean_name(const std::string& value) {
+    return toolbox::strings::substr_replace_all_ret(std::vector<std::string>{"/", ".", ":"}, "_", value);
+}
+
+std::string dockerpack::utils::cache_dir(const std::string& subdir) {
+    std::string root;
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if (xdg != nullptr && xdg[0] != '\0') {
+        root = std::string(xdg) + "/dockerpack";
+    } else {
+        const char* home = getenv("HOME");
+        root = std::string(home == nullptr ? "/tmp" : home) + "/.cache/dockerpack";
+    }
+
+    boost::filesystem::path out(root);
+    if (!subdir.empty()) {
+        out /= subdir;
+    }
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(out, ec);
+    return out.string();
+}
+
+std::string dockerpack::utils::shell_quote(const std::string& value) {
+    std::string out = "'";
+    for (char c : value) {
+        if (c == '\'') {
+            out += "'\\''";
+        } else {
+            out.push_back(c);
+        }
+    }
+    out += "'";
+    return out;
+}
+
+void dockerpack::utils::write_file_atomic(const std::string& path, const std::string& data) {
+    const std::string tmp = path + ".tmp" + boost::filesystem::unique_path("%%%%%%").string();
+    {
+        std::ofstream os(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!os.is_open()) {
+            throw std::runtime_error("Unable to write " + tmp);
+        }
+        os.write(data.data(), data.size());
+    }
+    boost::filesystem::rename(tmp, path);
+}
+
+uint64_t dockerpack::utils::parse_size(const std::string& value) {
+    size_t pos = 0;
+    uint64_t out = 0;
+    try {
+        out = std::stoull(value, &pos);
+    } catch (const std::exception&) {
+        throw std::runtime_error("Invalid size: " + value);
+    }
+
+    const std::string suffix = value.substr(pos);
+    if (suffix.empty() || suffix == "B" || suffix == "b") {
+        return out;
+    }
+    switch (suffix[0]) {
+    case 'K':
+    case 'k':
+        out <<= 10;
+        break;
+    case 'M':
+    case 'm':
+        out <<= 20;
+        break;
+    case 'G':
+    case 'g':
+        out <<= 30;
+        break;
+    case 'T':
+    case 't':
+        out <<= 40;
+        break;
+    default:
+        throw std::runtime_error("Invalid size: " + value);
+    }
+    if (suffix.size() > 1 && suffix.substr(1) != "B" && suffix.substr(1) != "iB") {
+        throw std::runtime_error("Invalid size: " + value);
+    }
+    return out;
+}
@@ -9,6 +9,7 @@
 #ifndef DOCKERPACK_UTILS_H
 #define DOCKERPACK_UTILS_H
 
+#include <cstdint>
 #include <string>
 
 namespace dockerpack {
@@ -16,6 +17,23 @@ namespace utils {
 
 void normalize_path(std::string& path);
 
+/// \brief Value usable in job and container name: "/", "." and ":" are replaced with "_"
+std::string clean_name(const std::string& value);
+
+/// \brief Per-user dockerpack cache directory: $XDG_CACHE_HOME/dockerpack or ~/.cache/dockerpack
+/// \param subdir created if not exists
+std::string cache_dir(const std::string& subdir = "");
+
+/// \brief Quote value for shell: wrap in single quotes
+std::string shell_quote(const std::string& value);
+
+/// \brief Write file atomically: write to temporary file and rename it
+void write_file_atomic(const std::string& path, const std::string& data);
+
+/// \brief Parse size with optional binary suffix: 1024, 512K, 200M, 5G
+/// \throws std::runtime_error on invalid value
+uint64_t parse_size(const std::string& value);
+
 } // namespace utils
 } // namespace dockerpack
 
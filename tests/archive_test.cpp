@@ -0,0 +1,241 @@
+/*!
+ * dockerpack.
+ * archive_test.cpp
+ *
+ * \date 10/17/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "archive.h"
+
+#include <boost/filesystem.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+struct tar_item {
+    std::string name;
+    std::string link;
+    char type = 0;
+    uint32_t mode = 0;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    std::string content;
+};
+
+static uint64_t read_octal(const char* field, size_t size) {
+    return std::strtoull(std::string(field, strnlen(field, size)).c_str(), nullptr, 8);
+}
+
+static std::string read_string(const char* field, size_t size) {
+    return std::string(field, strnlen(field, size));
+}
+
+/// \brief Parse archive written by tar_writer, pax "path" and "linkpath" records are applied to the next entry
+static std::vector<tar_item> read_tar(const std::string& archive) {
+    EXPECT_EQ(0u, archive.size() % 512);
+    std::vector<tar_item> out;
+    std::string pax_path, pax_link;
+    size_t pos = 0;
+    while (pos + 512 <= archive.size()) {
+        const char* header = archive.data() + pos;
+        if (std::string(header, 512) == std::string(512, '\0')) {
+            // end of archive: two zero blocks
+            EXPECT_EQ(pos + 1024, archive.size());
+            EXPECT_EQ(std::string(512, '\0'), archive.substr(pos + 512, 512));
+            return out;
+        }
+
+        unsigned int checksum = 0;
+        for (size_t i = 0; i < 512; i++) {
+            checksum += (i >= 148 && i < 156) ? ' ' : (unsigned char) header[i];
+        }
+        EXPECT_EQ(checksum, read_octal(header + 148, 8));
+        EXPECT_EQ("ustar", read_string(header + 257, 6));
+
+        tar_item item;
+        item.name = read_string(header, 100);
+        const std::string prefix = read_string(header + 345, 155);
+        if (!prefix.empty()) {
+            item.name = prefix + "/" + item.name;
+        }
+        item.link = read_string(header + 157, 100);
+        item.type = header[156];
+        item.mode = (uint32_t) read_octal(header + 100, 8);
+        item.size = read_octal(header + 124, 12);
+        item.mtime = (int64_t) read_octal(header + 136, 12);
+        item.content = archive.substr(pos + 512, item.size);
+        pos += 512 + (item.size + 511) / 512 * 512;
+
+        if (item.type == 'x') {
+            std::istringstream records(item.content);
+            size_t length;
+            while (records >> length) {
+                std::string record(length - std::to_string(length).size(), '\0');
+                records.read(&record[0], (std::streamsize) record.size());
+                // " key=value\n"
+                const size_t eq = record.find('=');
+                const std::string key = record.substr(1, eq - 1);
+                const std::string value = record.substr(eq + 1, record.size() - eq - 2);
+                if (key == "path") {
+                    pax_path = value;
+                } else if (key == "linkpath") {
+                    pax_link = value;
+                }
+            }
+            continue;
+        }
+        if (!pax_path.empty()) {
+            item.name = pax_path;
+        }
+        if (!pax_link.empty()) {
+            item.link = pax_link;
+        }
+        pax_path.clear();
+        pax_link.clear();
+        out.push_back(item);
+    }
+    ADD_FAILURE() << "archive is not finished";
+    return out;
+}
+
+static dockerpack::file_entry make_entry(char type, uint32_t mode, uint64_t size) {
+    dockerpack::file_entry entry;
+    entry.type = type;
+    entry.mode = mode;
+    entry.size = size;
+    entry.mtime = 1700000000123456789LL;
+    return entry;
+}
+
+TEST(TarWriter, RoundTrip) {
+    std::ostringstream os;
+    dockerpack::tar_writer writer(os);
+    writer.add("dir", make_entry('5', 0755, 0), "", "");
+    writer.add("dir/file.txt", make_entry('0', 0640, 5), "", "hello");
+    writer.add("dir/empty", make_entry('0', 0600, 0), "", "");
+    writer.add("dir/link", make_entry('2', 0777, 7), "", "file.txt");
+    writer.finish();
+
+    const std::vector<tar_item> items = read_tar(os.str());
+    ASSERT_EQ(4u, items.size());
+
+    ASSERT_EQ("dir", items[0].name);
+    ASSERT_EQ('5', items[0].type);
+    ASSERT_EQ(0755u, items[0].mode);
+    ASSERT_EQ(0u, items[0].size);
+    // nanoseconds are truncated to seconds
+    ASSERT_EQ(1700000000, items[0].mtime);
+
+    ASSERT_EQ("dir/file.txt", items[1].name);
+    ASSERT_EQ('0', items[1].type);
+    ASSERT_EQ(0640u, items[1].mode);
+    ASSERT_EQ(5u, items[1].size);
+    ASSERT_EQ("hello", items[1].content);
+
+    ASSERT_EQ("dir/empty", items[2].name);
+    ASSERT_EQ(0u, items[2].size);
+
+    // symlink size is always 0, target is in link field
+    ASSERT_EQ("dir/link", items[3].name);
+    ASSERT_EQ('2', items[3].type);
+    ASSERT_EQ(0u, items[3].size);
+    ASSERT_EQ("file.txt", items[3].link);
+}
+
+TEST(TarWriter, ContentSizeMatchesEntry) {
+    std::ostringstream os;
+    dockerpack::tar_writer writer(os);
+    // file was changed after scanning: archive keeps scanned size
+    writer.add("grown", make_entry('0', 0644, 3), "", "abcdef");
+    writer.add("shrunk", make_entry('0', 0644, 4), "", "ab");
+    writer.finish();
+
+    const std::vector<tar_item> items = read_tar(os.str());
+    ASSERT_EQ(2u, items.size());
+    ASSERT_EQ("abc", items[0].content);
+    ASSERT_EQ(std::string("ab\0\0", 4), items[1].content);
+}
+
+TEST(TarWriter, LongNames) {
+    const std::string name_100(100, 'a');
+    // fits ustar: prefix and name are split at "/"
+    const std::string split_name = std::string(120, 'p') + "/" + std::string(90, 'n');
+    // no "/" to split at
+    const std::string pax_name(150, 'x');
+    // longer than ustar prefix and name together
+    const std::string deep_name = std::string(200, 'd') + "/" + std::string(100, 'f');
+    const std::string long_link(150, 't');
+
+    std::ostringstream os;
+    dockerpack::tar_writer writer(os);
+    writer.add(name_100, make_entry('0', 0644, 1), "", "1");
+    writer.add(split_name, make_entry('0', 0644, 1), "", "2");
+    writer.add(pax_name, make_entry('0', 0644, 1), "", "3");
+    writer.add(deep_name, make_entry('5', 0755, 0), "", "");
+    writer.add("link", make_entry('2', 0777, long_link.size()), "", long_link);
+    writer.finish();
+
+    const std::string archive = os.str();
+    const std::vector<tar_item> items = read_tar(archive);
+    ASSERT_EQ(5u, items.size());
+    ASSERT_EQ(name_100, items[0].name);
+    ASSERT_EQ(split_name, items[1].name);
+    ASSERT_EQ("2", items[1].content);
+    ASSERT_EQ(pax_name, items[2].name);
+    ASSERT_EQ("3", items[2].content);
+    ASSERT_EQ(deep_name, items[3].name);
+    ASSERT_EQ('5', items[3].type);
+    ASSERT_EQ("link", items[4].name);
+    ASSERT_EQ(long_link, items[4].link);
+
+    // ustar names need no extended headers
+    size_t pax_headers = 0;
+    for (size_t pos = 0; pos + 512 <= archive.size(); pos += 512) {
+        if (archive[pos + 156] == 'x' && archive.compare(pos + 257, 5, "ustar") == 0) {
+            pax_headers++;
+        }
+    }
+    ASSERT_EQ(3u, pax_headers);
+}
+
+TEST(TarWriter, LocalFile) {
+    const fs::path dir = fs::temp_directory_path() / fs::unique_path("dockerpack-tar-%%%%-%%%%");
+    fs::create_directories(dir);
+    const std::string path = (dir / "data.bin").string();
+    std::string data(1500, '\0');
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (char) (i % 251);
+    }
+    {
+        std::ofstream os(path, std::ios::out | std::ios::binary);
+        os.write(data.data(), (std::streamsize) data.size());
+    }
+    fs::create_symlink("data.bin", dir / "link");
+
+    dockerpack::file_entry file, link;
+    ASSERT_TRUE(dockerpack::stat_entry(path, file));
+    ASSERT_TRUE(dockerpack::stat_entry((dir / "link").string(), link));
+    ASSERT_EQ('0', file.type);
+    ASSERT_EQ(data.size(), file.size);
+    ASSERT_EQ('2', link.type);
+
+    std::ostringstream os;
+    dockerpack::tar_writer writer(os);
+    writer.add("data.bin", file, path);
+    writer.add("link", link, (dir / "link").string());
+    writer.finish();
+    fs::remove_all(dir);
+
+    const std::vector<tar_item> items = read_tar(os.str());
+    ASSERT_EQ(2u, items.size());
+    ASSERT_EQ(data, items[0].content);
+    ASSERT_EQ(file.mode & 07777, items[0].mode);
+    ASSERT_EQ("data.bin", items[1].link);
+}
@@ -0,0 +1,424 @@
+/*!
+ * dockerpack.
+ * docker_api_test.cpp
+ *
+ * \date 10/17/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "docker_api.h"
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <functional>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <toolbox/strings.hpp>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace asio = boost::asio;
+namespace fs = boost::filesystem;
+using unix_socket = asio::local::stream_protocol::socket;
+
+struct fake_request {
+    std::string method;
+    std::string target;
+    std::unordered_map<std::string, std::string> headers;
+    // chunked body is decoded
+    std::string body;
+};
+
+/// \brief Docker daemon replacement listening on unix socket. Connections are served one by one:
+/// request is read completely, then raw response returned by handler is written and connection is closed.
+class fake_daemon {
+public:
+    using handler_t = std::function<std::string(const fake_request& req)>;
+
+    explicit fake_daemon(handler_t handler)
+        : m_handler(std::move(handler)),
+          m_path((fs::temp_directory_path() / fs::unique_path("dockerpack-test-%%%%-%%%%.sock")).string()),
+          m_acceptor(m_io, asio::local::stream_protocol::endpoint(m_path)) {
+        m_thread = std::thread([this]() {
+            serve();
+        });
+    }
+
+    ~fake_daemon() {
+        m_stopped = true;
+        // wake up blocked accept()
+        boost::system::error_code ec;
+        asio::io_context io;
+        unix_socket sock(io);
+        sock.connect(asio::local::stream_protocol::endpoint(m_path), ec);
+        m_thread.join();
+        fs::remove(m_path, ec);
+    }
+
+    const std::string& path() const {
+        return m_path;
+    }
+
+    std::vector<fake_request> requests() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_requests;
+    }
+
+private:
+    void serve() {
+        while (true) {
+            unix_socket sock(m_io);
+            boost::system::error_code ec;
+            m_acceptor.accept(sock, ec);
+            if (m_stopped) {
+                return;
+            }
+            if (ec) {
+                continue;
+            }
+
+            try {
+                const fake_request req = read_request(sock);
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    m_requests.push_back(req);
+                }
+                asio::write(sock, asio::buffer(m_handler(req)));
+            } catch (const std::exception&) {
+                // client has gone
+            }
+            sock.shutdown(unix_socket::shutdown_both, ec);
+            sock.close(ec);
+        }
+    }
+
+    static fake_request read_request(unix_socket& sock) {
+        asio::streambuf buf;
+        const size_t head_len = asio::read_until(sock, buf, "\r\n\r\n");
+        const std::string head(asio::buffers_begin(buf.data()), asio::buffers_begin(buf.data()) + head_len);
+        buf.consume(head_len);
+
+        fake_request req;
+        const auto lines = toolbox::strings::split(head, "\r\n");
+        std::stringstream request_line(lines.at(0));
+        request_line >> req.method >> req.target;
+        for (size_t i = 1; i < lines.size(); i++) {
+            auto kv = toolbox::strings::split_pair(lines[i], ":");
+            if (kv.first.empty()) {
+                continue;
+            }
+            toolbox::strings::trim_ref(kv.second);
+            req.headers[toolbox::strings::to_lower_case(kv.first)] = kv.second;
+        }
+
+        if (req.headers.count("content-length")) {
+            const size_t size = std::stoul(req.headers.at("content-length"));
+            if (buf.size() < size) {
+                asio::read(sock, buf, asio::transfer_at_least(size - buf.size()));
+            }
+            req.body.assign(asio::buffers_begin(buf.data()), asio::buffers_begin(buf.data()) + size);
+        } else if (req.headers.count("transfer-encoding")) {
+            while (true) {
+                const size_t line_len = asio::read_until(sock, buf, "\r\n");
+                const std::string size_line(asio::buffers_begin(buf.data()), asio::buffers_begin(buf.data()) + line_len - 2);
+                buf.consume(line_len);
+                const size_t size = std::stoul(size_line, nullptr, 16);
+                if (buf.size() < size + 2) {
+                    asio::read(sock, buf, asio::transfer_at_least(size + 2 - buf.size()));
+                }
+                req.body.append(asio::buffers_begin(buf.data()), asio::buffers_begin(buf.data()) + size);
+                buf.consume(size + 2);
+                if (size == 0) {
+                    break;
+                }
+            }
+        }
+        return req;
+    }
+
+    handler_t m_handler;
+    std::string m_path;
+    asio::io_context m_io;
+    asio::local::stream_protocol::acceptor m_acceptor;
+    std::thread m_thread;
+    std::atomic_bool m_stopped{false};
+    std::mutex m_lock;
+    std::vector<fake_request> m_requests;
+};
+
+static std::string json_response(int status, const std::string& body) {
+    return "HTTP/1.1 " + std::to_string(status) + " OK\r\nContent-Type: application/json\r\nContent-Length: " +
+           std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+/// \brief Multiplexed stream frame: 1 - stdout, 2 - stderr
+static std::string frame(uint8_t stream, const std::string& payload) {
+    std::string out(8, '\0');
+    out[0] = (char) stream;
+    out[4] = (char) ((payload.size() >> 24) & 0xFF);
+    out[5] = (char) ((payload.size() >> 16) & 0xFF);
+    out[6] = (char) ((payload.size() >> 8) & 0xFF);
+    out[7] = (char) (payload.size() & 0xFF);
+    return out + payload;
+}
+
+static std::string tar_name(const std::string& archive) {
+    return std::string(archive.c_str());
+}
+
+TEST(UnixHttpClient, SizedBody) {
+    fake_daemon daemon([](const fake_request&) {
+        return std::string("HTTP/1.1 200 OK\r\nContent-Length: 11\r\nX-Custom:  value \r\n\r\nhello world");
+    });
+
+    dockerpack::unix_http_client client(daemon.path());
+    const auto res = client.request("POST", "/v1.40/containers/create", R"({"Image":"debian"})");
+
+    ASSERT_EQ(200, res.status);
+    ASSERT_EQ("hello world", res.body);
+    ASSERT_EQ("value", res.headers.at("x-custom"));
+
+    const auto requests = daemon.requests();
+    ASSERT_EQ(1u, requests.size());
+    ASSERT_EQ("POST", requests[0].method);
+    ASSERT_EQ("/v1.40/containers/create", requests[0].target);
+    ASSERT_EQ("application/json", requests[0].headers.at("content-type"));
+    ASSERT_EQ(R"({"Image":"debian"})", requests[0].body);
+}
+
+TEST(UnixHttpClient, ChunkedBody) {
+    fake_daemon daemon([](const fake_request&) {
+        return std::string(
+            "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "6\r\nhello \r\n"
+            "a\r\n0123456789\r\n"
+            "0\r\n\r\n");
+    });
+
+    dockerpack::unix_http_client client(daemon.path());
+    std::vector<std::string> parts;
+    const auto res = client.stream("GET", "/v1.40/events", "", [&parts](const char* data, size_t size) {
+        parts.emplace_back(data, size);
+    });
+
+    ASSERT_EQ(200, res.status);
+    ASSERT_TRUE(res.body.empty());
+    ASSERT_EQ(2u, parts.size());
+    ASSERT_EQ("hello ", parts[0]);
+    ASSERT_EQ("0123456789", parts[1]);
+}
+
+TEST(UnixHttpClient, BodyUntilEof) {
+    fake_daemon daemon([](const fake_request&) {
+        return std::string("HTTP/1.1 101 UPGRADED\r\nContent-Type: application/vnd.docker.raw-stream\r\n\r\nraw stream data");
+    });
+
+    dockerpack::unix_http_client client(daemon.path());
+    const auto res = client.request("POST", "/v1.40/exec/abc/start", "{}");
+
+    ASSERT_EQ(101, res.status);
+    ASSERT_EQ("raw stream data", res.body);
+}
+
+TEST(UnixHttpClient, UploadIsChunked) {
+    fake_daemon daemon([](const fake_request&) {
+        return std::string("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+    });
+
+    const std::string payload(300 * 1024, 'x');
+    dockerpack::unix_http_client client(daemon.path());
+    const auto res = client.upload("PUT", "/v1.40/containers/c1/archive?path=%2F", "application/x-tar", [&payload](std::ostream& os) {
+        os << payload << "tail";
+    });
+
+    ASSERT_EQ(200, res.status);
+    const auto requests = daemon.requests();
+    ASSERT_EQ(1u, requests.size());
+    ASSERT_EQ("chunked", requests[0].headers.at("transfer-encoding"));
+    ASSERT_EQ("application/x-tar", requests[0].headers.at("content-type"));
+    ASSERT_EQ(payload + "tail", requests[0].body);
+}
+
+TEST(StreamDemuxer, SplitFrames) {
+    std::vector<std::pair<bool, std::string>> lines;
+    dockerpack::stream_demuxer demuxer([&lines](bool is_stderr, const std::string& line) {
+        lines.emplace_back(is_stderr, line);
+    });
+
+    const std::string data = frame(1, "first\nsec") + frame(2, "error line\n") + frame(1, "ond\nlast") + frame(2, "no newline");
+    // headers and payloads are split at every possible position
+    for (char c : data) {
+        demuxer.feed(&c, 1);
+    }
+    ASSERT_EQ(3u, lines.size());
+    demuxer.finish();
+
+    ASSERT_EQ(5u, lines.size());
+    ASSERT_EQ(std::make_pair(false, std::string("first")), lines[0]);
+    ASSERT_EQ(std::make_pair(true, std::string("error line")), lines[1]);
+    ASSERT_EQ(std::make_pair(false, std::string("second")), lines[2]);
+    ASSERT_EQ(std::make_pair(false, std::string("last")), lines[3]);
+    ASSERT_EQ(std::make_pair(true, std::string("no newline")), lines[4]);
+}
+
+TEST(StreamDemuxer, LargeFrame) {
+    std::vector<std::pair<bool, std::string>> lines;
+    dockerpack::stream_demuxer demuxer([&lines](bool is_stderr, const std::string& line) {
+        lines.emplace_back(is_stderr, line);
+    });
+
+    // size takes more than one byte of header
+    const std::string long_line(70000, 'a');
+    const std::string data = frame(2, long_line + "\n");
+    demuxer.feed(data.data(), data.size());
+
+    ASSERT_EQ(1u, lines.size());
+    ASSERT_TRUE(lines[0].first);
+    ASSERT_EQ(long_line, lines[0].second);
+}
+
+/// \brief Serves exec create, start and inspect of single exec instance
+static fake_daemon::handler_t exec_handler(const std::string& stream, const std::string& exit_code) {
+    return [stream, exit_code](const fake_request& req) {
+        if (req.method == "POST" && req.target == "/v1.40/containers/c1/exec") {
+            return json_response(201, R"({"Id":"e1"})");
+        } else if (req.method == "POST" && req.target == "/v1.40/exec/e1/start") {
+            // chunk boundary splits frame header
+            const std::string first = stream.substr(0, 3);
+            const std::string rest = stream.substr(3);
+            std::stringstream ss;
+            ss << "HTTP/1.1 200 OK\r\nContent-Type: application/vnd.docker.multiplexed-stream\r\nTransfer-Encoding: chunked\r\n\r\n";
+            ss << std::hex << first.size() << "\r\n"
+               << first << "\r\n";
+            ss << std::hex << rest.size() << "\r\n"
+               << rest << "\r\n";
+            ss << "0\r\n\r\n";
+            return ss.str();
+        } else if (req.method == "GET" && req.target == "/v1.40/exec/e1/json") {
+            return json_response(200, R"({"Running":false,"ExitCode":)" + exit_code + "}");
+        }
+        return json_response(404, R"({"message":"unexpected request"})");
+    };
+}
+
+TEST(ApiBackend, ExecExitCode) {
+    fake_daemon daemon(exec_handler(frame(1, "building\n") + frame(2, "warning\n"), "3"));
+
+    dockerpack::api_backend backend(daemon.path());
+    dockerpack::exec_options opts;
+    opts.command = "make";
+    opts.workdir = "/src";
+    opts.output = false;
+
+    ASSERT_EQ(3, backend.exec("c1", opts));
+
+    const auto requests = daemon.requests();
+    ASSERT_EQ(3u, requests.size());
+    const auto create = nlohmann::json::parse(requests[0].body);
+    ASSERT_EQ("/src", create.at("WorkingDir").get<std::string>());
+    ASSERT_TRUE(create.at("AttachStderr").get<bool>());
+}
+
+TEST(ApiBackend, ExecExitCodeNotSet) {
+    fake_daemon daemon(exec_handler(frame(1, "done\n"), "null"));
+
+    dockerpack::api_backend backend(daemon.path());
+    dockerpack::exec_options opts;
+    opts.command = "true";
+    opts.output = false;
+
+    ASSERT_EQ(0, backend.exec("c1", opts));
+}
+
+TEST(ApiBackend, ExecOutput) {
+    {
+        fake_daemon daemon(exec_handler(frame(1, "line 1\n") + frame(2, "noise\n") + frame(1, "line 2"), "0"));
+        dockerpack::api_backend backend(daemon.path());
+        ASSERT_EQ("line 1\nline 2\n", backend.exec_output("c1", "cat file"));
+    }
+    {
+        fake_daemon daemon(exec_handler(frame(1, "partial\n") + frame(2, "no such file\n"), "1"));
+        dockerpack::api_backend backend(daemon.path());
+        try {
+            backend.exec_output("c1", "cat file");
+            FAIL() << "exception expected";
+        } catch (const std::runtime_error& e) {
+            ASSERT_EQ(std::string("no such file\n"), e.what());
+        }
+    }
+}
+
+TEST(ApiBackend, CopyFile) {
+    const fs::path local = fs::temp_directory_path() / fs::unique_path("dockerpack-test-%%%%-%%%%.txt");
+    {
+        std::ofstream os(local.string());
+        os << "file content";
+    }
+    const std::string local_name = local.filename().string();
+
+    // {"name":"app","size":4096,"mode":2147484141} - directory
+    const std::string dir_stat = "eyJuYW1lIjoiYXBwIiwic2l6ZSI6NDA5NiwibW9kZSI6MjE0NzQ4NDE0MX0=";
+    fake_daemon daemon([&dir_stat](const fake_request& req) {
+        if (req.method == "HEAD" && req.target == "/v1.40/containers/c1/archive?path=%2Fapp") {
+            return "HTTP/1.1 200 OK\r\nX-Docker-Container-Path-Stat: " + dir_stat + "\r\nContent-Length: 0\r\n\r\n";
+        } else if (req.method == "HEAD") {
+            return json_response(404, R"({"message":"Could not find the file"})");
+        } else if (req.method == "PUT") {
+            return std::string("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+        }
+        return json_response(404, R"({"message":"unexpected request"})");
+    });
+    dockerpack::api_backend backend(daemon.path());
+
+    // existing directory: file keeps it's name
+    backend.copy(local.string(), "c1", "/app");
+    // new path: file is renamed
+    backend.copy(local.string(), "c1", "/app/config.txt");
+
+    const auto requests = daemon.requests();
+    fs::remove(local);
+    ASSERT_EQ(4u, requests.size());
+
+    ASSERT_EQ("PUT", requests[1].method);
+    ASSERT_EQ("/v1.40/containers/c1/archive?path=%2Fapp", requests[1].target);
+    ASSERT_EQ("application/x-tar", requests[1].headers.at("content-type"));
+    ASSERT_EQ(4u * 512, requests[1].body.size());
+    ASSERT_EQ(local_name, tar_name(requests[1].body));
+    ASSERT_EQ("file content", requests[1].body.substr(512, 12));
+
+    ASSERT_EQ("/v1.40/containers/c1/archive?path=%2Fapp%2Fconfig.txt", requests[2].target);
+    ASSERT_EQ("/v1.40/containers/c1/archive?path=%2Fapp", requests[3].target);
+    ASSERT_EQ("config.txt", tar_name(requests[3].body));
+}
+
+TEST(ApiBackend, CopyFileError) {
+    const fs::path local = fs::temp_directory_path() / fs::unique_path("dockerpack-test-%%%%-%%%%.txt");
+    {
+        std::ofstream os(local.string());
+        os << "file content";
+    }
+
+    fake_daemon daemon([](const fake_request& req) {
+        if (req.method == "HEAD") {
+            return json_response(404, R"({"message":"Could not find the file"})");
+        }
+        return json_response(404, R"({"message":"parent directory does not exist"})");
+    });
+    dockerpack::api_backend backend(daemon.path());
+
+    ASSERT_THROW(backend.copy(local.string(), "c1", "/missing/"), std::runtime_error);
+    try {
+        backend.copy(local.string(), "c1", "/missing/file.txt");
+        FAIL() << "exception expected";
+    } catch (const std::runtime_error& e) {
+        ASSERT_TRUE(toolbox::strings::has_substring("parent directory does not exist", e.what()));
+    }
+    fs::remove(local);
+}
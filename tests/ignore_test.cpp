@@ -0,0 +1,138 @@
+/*!
+ * dockerpack.
+ * ignore_test.cpp
+ *
+ * \date 10/17/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "ignore.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+struct ignore_case {
+    std::string path;
+    bool is_dir;
+    bool ignored;
+};
+
+static void check_rules(const std::vector<std::string>& patterns, const std::vector<ignore_case>& cases) {
+    dockerpack::ignore_rules rules;
+    for (const auto& pattern : patterns) {
+        rules.add(pattern);
+    }
+    for (const auto& c : cases) {
+        SCOPED_TRACE(c.path + (c.is_dir ? "/" : ""));
+        EXPECT_EQ(c.ignored, rules.ignored(c.path, c.is_dir));
+    }
+}
+
+TEST(IgnoreRules, DoubleStar) {
+    check_rules({"**/build", "docs/**", "a/**/z"},
+                {
+                    {"build", true, true},
+                    {"src/lib/build", true, true},
+                    {"builds", true, false},
+                    {"docs/a/b.md", false, true},
+                    {"docs", true, false},
+                    {"a/z", false, true},
+                    {"a/b/c/z", false, true},
+                    {"ab/z", false, false},
+                });
+}
+
+TEST(IgnoreRules, Wildcards) {
+    check_rules({"*.o", "a?c", "/root.txt"},
+                {
+                    {"main.o", false, true},
+                    {"src/deep/main.o", false, true},
+                    {"main.c", false, false},
+                    {"abc", false, true},
+                    {"a/c", false, false},
+                    {"abbc", false, false},
+                    {"root.txt", false, true},
+                    {"sub/root.txt", false, false},
+                });
+}
+
+TEST(IgnoreRules, CharacterClasses) {
+    check_rules({"*.[ch]", "file[0-9]", "[!a]bc", "x[]]y", "open[ab"},
+                {
+                    {"x.c", false, true},
+                    {"src/x.h", false, true},
+                    {"x.o", false, false},
+                    {"file7", false, true},
+                    {"filex", false, false},
+                    {"xbc", false, true},
+                    {"abc", false, false},
+                    {"x]y", false, true},
+                    {"xay", false, false},
+                    {"open[ab", false, true},
+                    {"opena", false, false},
+                });
+}
+
+TEST(IgnoreRules, Escapes) {
+    check_rules({"# comment", "\\#hash", "\\!bang", "star\\*", "trail\\ ", "spaces  "},
+                {
+                    {"# comment", false, false},
+                    {"#hash", false, true},
+                    {"!bang", false, true},
+                    {"star*", false, true},
+                    {"starlet", false, false},
+                    {"trail ", false, true},
+                    {"trail", false, false},
+                    {"spaces", false, true},
+                });
+}
+
+TEST(IgnoreRules, Negation) {
+    check_rules({"*.log", "!keep.log", "!logs/"},
+                {
+                    {"a.log", false, true},
+                    {"deep/a.log", false, true},
+                    {"keep.log", false, false},
+                    {"deep/keep.log", false, false},
+                    {"other.txt", false, false},
+                });
+}
+
+TEST(IgnoreRules, DirectoryOnly) {
+    check_rules({"tmp/", "/out/"},
+                {
+                    {"tmp", true, true},
+                    {"tmp", false, false},
+                    {"a/tmp", true, true},
+                    {"out", true, true},
+                    {"a/out", true, false},
+                    {"out", false, false},
+                });
+}
+
+TEST(IgnoreRules, LastMatchWins) {
+    check_rules({"*.txt", "!*.txt", "secret.txt", "data/", "!data/"},
+                {
+                    {"a.txt", false, false},
+                    {"secret.txt", false, true},
+                    {"sub/secret.txt", false, true},
+                    {"data", true, false},
+                });
+
+    check_rules({"!keep.txt", "*.txt"},
+                {
+                    {"keep.txt", false, true},
+                });
+}
+
+TEST(IgnoreRules, Empty) {
+    dockerpack::ignore_rules rules;
+    ASSERT_TRUE(rules.empty());
+    rules.add("");
+    rules.add("   ");
+    rules.add("# only comment");
+    rules.add("!");
+    ASSERT_TRUE(rules.empty());
+    ASSERT_FALSE(rules.ignored("anything", false));
+}
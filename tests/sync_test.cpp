@@ -0,0 +1,135 @@
+/*!
+ * dockerpack.
+ * sync_test.cpp
+ *
+ * \date 10/17/2026
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+#include "sync.h"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+class DirSync : public ::testing::Test {
+protected:
+    void SetUp() override {
+        m_root = fs::temp_directory_path() / fs::unique_path("dockerpack-sync-%%%%-%%%%");
+        fs::create_directories(m_root / "src");
+        m_manifest = (m_root / "manifest.json").string();
+    }
+
+    void TearDown() override {
+        fs::remove_all(m_root);
+    }
+
+    void write(const std::string& rel_path, const std::string& content) {
+        const fs::path path = src() / rel_path;
+        fs::create_directories(path.parent_path());
+        std::ofstream os(path.string(), std::ios::out | std::ios::binary | std::ios::trunc);
+        os << content;
+    }
+
+    fs::path src() const {
+        return m_root / "src";
+    }
+
+    /// \brief Plan sync of src directory, manifest is saved as if changes were transferred
+    dockerpack::sync_plan sync(const std::vector<std::string>& patterns = {}) {
+        dockerpack::ignore_rules rules;
+        for (const auto& pattern : patterns) {
+            rules.add(pattern);
+        }
+        dockerpack::dir_sync syncer(src().string(), "", m_manifest, rules, 2);
+        dockerpack::sync_plan plan = syncer.plan();
+        syncer.commit();
+        return plan;
+    }
+
+    fs::path m_root;
+    std::string m_manifest;
+};
+
+TEST_F(DirSync, FirstSyncTransfersEverything) {
+    write("a.txt", "aaa");
+    write("dir/b.txt", "bb");
+
+    const dockerpack::sync_plan plan = sync();
+    ASSERT_EQ(std::vector<std::string>({"a.txt", "dir", "dir/b.txt"}), plan.changed);
+    ASSERT_TRUE(plan.deleted.empty());
+    ASSERT_EQ(5u, plan.bytes);
+
+    ASSERT_TRUE(sync().empty());
+}
+
+TEST_F(DirSync, Changed) {
+    write("same.txt", "same");
+    write("touched.txt", "touched");
+    write("edited.txt", "before");
+    sync();
+
+    write("edited.txt", "after edit");
+    // new mtime, same content: hashed again, but not transferred
+    fs::last_write_time(src() / "touched.txt", fs::last_write_time(src() / "touched.txt") - 10);
+    write("dir/new.txt", "new");
+    fs::permissions(src() / "same.txt", fs::owner_all);
+
+    const dockerpack::sync_plan plan = sync();
+    ASSERT_EQ(std::vector<std::string>({"dir", "dir/new.txt", "edited.txt", "same.txt"}), plan.changed);
+    ASSERT_TRUE(plan.deleted.empty());
+    ASSERT_EQ(17u, plan.bytes);
+}
+
+TEST_F(DirSync, Deleted) {
+    write("keep.txt", "keep");
+    write("gone.txt", "gone");
+    write("dir/gone.txt", "gone");
+    write("dir/keep.txt", "keep");
+    sync();
+
+    fs::remove(src() / "gone.txt");
+    fs::remove(src() / "dir" / "gone.txt");
+
+    const dockerpack::sync_plan plan = sync();
+    ASSERT_TRUE(plan.changed.empty());
+    ASSERT_EQ(std::vector<std::string>({"dir/gone.txt", "gone.txt"}), plan.deleted);
+}
+
+TEST_F(DirSync, NewlyIgnoredIsNotDeleted) {
+    write("app.log", "log");
+    write("build/out.o", "obj");
+    write("main.cpp", "int main() {}");
+    sync();
+
+    // ignored entries are left in container as is
+    const dockerpack::sync_plan plan = sync({"*.log", "build/"});
+    ASSERT_TRUE(plan.empty());
+
+    // and they are forgotten, so they are transferred again when they are not ignored anymore
+    const dockerpack::sync_plan back = sync();
+    ASSERT_EQ(std::vector<std::string>({"app.log", "build", "build/out.o"}), back.changed);
+    ASSERT_TRUE(back.deleted.empty());
+}
+
+TEST_F(DirSync, DeletedDirectoryIsCollapsed) {
+    write("dir/a.txt", "a");
+    write("dir/sub/b.txt", "b");
+    write("dir-x/c.txt", "c");
+    write("dir.txt", "d");
+    write("other/keep.txt", "keep");
+    sync();
+
+    fs::remove_all(src() / "dir");
+    fs::remove_all(src() / "dir-x");
+    fs::remove(src() / "dir.txt");
+
+    // "dir-x" and "dir.txt" are sorted between "dir" and "dir/a.txt"
+    const dockerpack::sync_plan plan = sync();
+    ASSERT_TRUE(plan.changed.empty());
+    ASSERT_EQ(std::vector<std::string>({"dir", "dir-x", "dir.txt"}), plan.deleted);
+}